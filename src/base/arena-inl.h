@@ -6,6 +6,7 @@
 #include <stddef.h>
 #include <new>
 #include <memory>
+#include <utility>
 
 namespace mrpc {
 
@@ -37,13 +38,10 @@ class ArenaAllocator {
     void deallocate(pointer p, size_type n) {
       arena_->Free(p, n * sizeof(T));
     }
-    void construct(pointer p, const T & val) {
-      new(reinterpret_cast<void*>(p)) T(val);
+    template<class U, class... Args> void construct(U* p, Args&&... args) {
+      new(reinterpret_cast<void*>(p)) U(std::forward<Args>(args)...);
     }
-    void construct(pointer p) {
-      new(reinterpret_cast<void*>(p)) T();
-    }
-    void destroy(pointer p) { p->~T(); }
+    template<class U> void destroy(U* p) { p->~U(); }
   
     C* arena(void) const { return arena_; }
   
@@ -1,9 +1,12 @@
 #include "base/arena.h"
 #include "base/arena-inl.h"
 #include <assert.h>
+#include <stddef.h>
 #include <algorithm>
 #include <unistd.h>
+#include <map>
 #include <vector>
+#include <sys/mman.h>
 #include <sys/types.h>         // one place uintptr_t might be
 #include <inttypes.h>
 #include "base/macros.h"       // for uint64
@@ -25,8 +28,18 @@ static void* aligned_malloc(size_t size, size_t alignment) {
   }
 }
 
-// The value here doesn't matter until page_aligned_ is supported.
-static const int kPageSize = 8192;   // should be getpagesize()
+// page_aligned_ blocks are aligned to, and sized in, pages of this size.
+static size_t PageSize() {
+  static const size_t page_size = getpagesize();
+  return page_size;
+}
+
+// Transparent and hugetlbfs huge pages on x86-64.
+static const size_t kHugePageSize = 2 << 20;
+
+static size_t RoundUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) & ~(alignment - 1);
+}
 
 namespace mrpc {
 
@@ -52,65 +65,118 @@ BaseArena::BaseArena(char* first, const size_t block_size, bool align_to_page)
     freestart_(NULL),                   // set for real in Reset()
     last_alloc_(NULL),
     blocks_alloced_(1),
+    block_count_(1),
     overflow_blocks_(NULL),
     page_aligned_(align_to_page),
     handle_alignment_(1),
     handle_alignment_bits_(0),
-    block_size_bits_(0) {
-  assert(block_size > kDefaultAlignment);
+    block_size_bits_(0),
+    next_block_size_(0),
+    max_block_size_(0),
+    growth_multiplier_(1),
+    block_source_(MALLOC_BLOCKS),
+    max_free_blocks_(0),
+    block_pool_(NULL),
+    cleanups_(NULL),
+    cleanup_count_(0),
+    name_("<unnamed>"),
+    status_mutex_(NULL),
+    registered_(false),
+    prev_live_(NULL),
+    next_live_(NULL) {
+  Init(first);
+}
+
+BaseArena::BaseArena(ArenaBlockPool* pool, bool align_to_page)
+  : remaining_(0),
+    first_block_we_own_(0),
+    block_size_(pool->block_size()),
+    freestart_(NULL),                   // set for real in Reset()
+    last_alloc_(NULL),
+    blocks_alloced_(1),
+    block_count_(1),
+    overflow_blocks_(NULL),
+    page_aligned_(align_to_page),
+    handle_alignment_(1),
+    handle_alignment_bits_(0),
+    block_size_bits_(0),
+    next_block_size_(0),
+    max_block_size_(0),
+    growth_multiplier_(1),
+    block_source_(MALLOC_BLOCKS),
+    max_free_blocks_(0),
+    block_pool_(pool),
+    cleanups_(NULL),
+    cleanup_count_(0),
+    name_("<unnamed>"),
+    status_mutex_(NULL),
+    registered_(false),
+    prev_live_(NULL),
+    next_live_(NULL) {
+  CHECK_EQ(pool->page_aligned(), align_to_page);
+  Init(NULL);
+}
+
+void BaseArena::Init(char* first) {
+  assert(block_size_ > kDefaultAlignment);
+  next_block_size_ = block_size_;
+  max_block_size_ = block_size_;
 
   while ((static_cast<size_t>(1) << block_size_bits_) < block_size_) {
     ++block_size_bits_;
   }
 
   if (page_aligned_) {
-    // kPageSize must be power of 2, so make sure of this.
-    CHECK(kPageSize > 0 && 0 == (kPageSize & (kPageSize - 1)))
-                              << "kPageSize[ " << kPageSize << "] is not "
+    // The page size must be power of 2, so make sure of this.
+    CHECK(PageSize() > 0 && 0 == (PageSize() & (PageSize() - 1)))
+                              << "PageSize()[ " << PageSize() << "] is not "
                               << "correctly initialized: not a power of 2.";
   }
 
   if (first) {
     CHECK(!page_aligned_ ||
-          (reinterpret_cast<uintptr_t>(first) & (kPageSize - 1)) == 0);
+          (reinterpret_cast<uintptr_t>(first) & (PageSize() - 1)) == 0);
     first_blocks_[0].mem = first;
   } else {
     if (page_aligned_) {
       // Make sure the blocksize is page multiple, as we need to end on a page
       // boundary.
-      CHECK_EQ(block_size & (kPageSize - 1), 0) << "block_size is not a"
-                                                << "multiple of kPageSize";
-      first_blocks_[0].mem = reinterpret_cast<char*>(aligned_malloc(block_size_,
-                                                                    kPageSize));
-      PCHECK(NULL != first_blocks_[0].mem);
-    } else {
-      first_blocks_[0].mem = reinterpret_cast<char*>(malloc(block_size_));
+      CHECK_EQ(block_size_ & (PageSize() - 1), 0) << "block_size is not a"
+                                                 << "multiple of PageSize()";
     }
+    first_blocks_[0].mem = NewBlockMemory(block_size_);
   }
   first_blocks_[0].size = block_size_;
 
   Reset();
+  // The constructor's Reset() is not a cycle.
+  status_ = Status();
+  status_.bytes_allocated_ = block_size_;
 }
 
 BaseArena::~BaseArena() {
+  UnregisterArena();
+  RunCleanups();
   FreeBlocks();
   assert(overflow_blocks_ == NULL);    // FreeBlocks() should do that
+  // Nothing is recycled locally from here on.
+  max_free_blocks_ = 0;
+  for (size_t i = 0; i < free_blocks_.size(); ++i)
+    ReleaseBlockMemory(free_blocks_[i].mem, free_blocks_[i].size);
   for ( int i = first_block_we_own_; i < blocks_alloced_; ++i )
-    free(first_blocks_[i].mem);
-}
-
-int BaseArena::block_count() const {
-  return (blocks_alloced_ +
-          (overflow_blocks_ ? static_cast<int>(overflow_blocks_->size()) : 0));
+    ReleaseBlockMemory(first_blocks_[i].mem, first_blocks_[i].size);
 }
 
 void BaseArena::Reset() {
+  RunCleanups();
   FreeBlocks();
+  RecordReset();
   freestart_ = first_blocks_[0].mem;
   remaining_ = first_blocks_[0].size;
   last_alloc_ = NULL;
+  next_block_size_ = block_size_;
 
-  ARENASET(status_.bytes_allocated_ = block_size_);
+  ARENASET(StoreCounter(&status_.bytes_allocated_, block_size_));
 
   const int overage = reinterpret_cast<uintptr_t>(freestart_) &
                       (kDefaultAlignment-1);
@@ -123,10 +189,58 @@ void BaseArena::Reset() {
   assert(!(reinterpret_cast<uintptr_t>(freestart_)&(kDefaultAlignment-1)));
 }
 
+void BaseArena::RecordReset() {
+  const size_t requested = status_.bytes_requested_;
+  int bucket = 0;
+  if (requested > 0) {
+    bucket = 64 - __builtin_clzll(static_cast<unsigned long long>(requested));
+    bucket = min(bucket, Status::kHistogramBuckets - 1);
+  }
+  AddToCounter(&status_.reset_histogram_[bucket], 1);
+  AddToCounter(&status_.reset_count_, 1);
+  StoreCounter(&status_.peak_bytes_requested_, status_.peak_bytes_requested());
+  StoreCounter(&status_.peak_bytes_allocated_, status_.peak_bytes_allocated());
+  StoreCounter(&status_.bytes_requested_, 0);
+  StoreCounter(&status_.bytes_wasted_, 0);
+  StoreCounter(&status_.oversize_blocks_, 0);
+  StoreCounter(&status_.oversize_bytes_, 0);
+}
+
 void BaseArena::MakeNewBlock() {
-  AllocatedBlock *block = AllocNewBlock(block_size_);
+  // Whatever is left of the current block is never handed out.
+  AddToCounter(&status_.bytes_wasted_, remaining_);
+  AllocatedBlock *block = AllocNewBlock(next_block_size_);
   freestart_ = block->mem;
   remaining_ = block->size;
+  if (next_block_size_ < max_block_size_) {
+    next_block_size_ = min(next_block_size_ * growth_multiplier_,
+                           max_block_size_);
+  }
+}
+
+bool BaseArena::IsRegularBlockSize(size_t size) const {
+  for (size_t regular = block_size_; ;
+       regular = min(regular * growth_multiplier_, max_block_size_)) {
+    if (regular == size)
+      return true;
+    if (regular >= max_block_size_ || regular > size ||
+        growth_multiplier_ == 1)
+      return false;
+  }
+}
+
+void BaseArena::set_block_growth(int multiplier, size_t max_block_size) {
+  CHECK_GE(multiplier, 1);
+  CHECK_GE(max_block_size, block_size_);
+  CHECK(!page_aligned_ || (max_block_size & (PageSize() - 1)) == 0);
+  CHECK(is_empty());
+  growth_multiplier_ = multiplier;
+  max_block_size_ = max_block_size;
+  next_block_size_ = block_size_;
+  block_size_bits_ = 0;
+  while ((static_cast<size_t>(1) << block_size_bits_) < max_block_size_) {
+    ++block_size_bits_;
+  }
 }
 
 BaseArena::AllocatedBlock*  BaseArena::AllocNewBlock(const size_t block_size) {
@@ -140,18 +254,19 @@ BaseArena::AllocatedBlock*  BaseArena::AllocNewBlock(const size_t block_size) {
   }
 
   if (page_aligned_) {
-    size_t num_pages = ((block_size - 1) / kPageSize) + 1;
-    size_t new_block_size = num_pages * kPageSize;
-    block->mem = reinterpret_cast<char*>(aligned_malloc(new_block_size,
-                                                        kPageSize));
-    PCHECK(NULL != block->mem);
+    size_t num_pages = ((block_size - 1) / PageSize()) + 1;
+    size_t new_block_size = num_pages * PageSize();
+    block->mem = NewBlockMemory(new_block_size);
     block->size = new_block_size;
   } else {
-    block->mem = reinterpret_cast<char*>(malloc(block_size));
+    block->mem = NewBlockMemory(block_size);
     block->size = block_size;
   }
 
-  ARENASET(status_.bytes_allocated_ += block_size);
+  ARENASET(AddToCounter(&status_.bytes_allocated_, block_size));
+  if (status_.bytes_allocated_ > status_.peak_bytes_allocated_)
+    StoreCounter(&status_.peak_bytes_allocated_, status_.bytes_allocated_);
+  AddToCounter(&block_count_, 1);
 
   return block;
 }
@@ -175,8 +290,11 @@ void* BaseArena::GetMemoryFallback(const size_t size, const int align_as_int) {
   const size_t align = static_cast<size_t>(align_as_int);
 
   assert(align_as_int > 0 && 0 == (align & (align - 1))); // must be power of 2
-  if (block_size_ == 0 || size > block_size_/4) {
-    assert(align <= kDefaultAlignment);   // because that's what new gives us
+  if (block_size_ == 0 || size > next_block_size_/4) {
+    // Blocks come from malloc or mmap, aligned for any fundamental type.
+    assert(align <= alignof(max_align_t));
+    AddToCounter(&status_.oversize_blocks_, 1);
+    AddToCounter(&status_.oversize_bytes_, size);
     return AllocNewBlock(size)->mem;
   }
 
@@ -187,7 +305,9 @@ void* BaseArena::GetMemoryFallback(const size_t size, const int align_as_int) {
     freestart_ += waste;
     if (waste < remaining_) {
       remaining_ -= waste;
+      AddToCounter(&status_.bytes_wasted_, waste);
     } else {
+      AddToCounter(&status_.bytes_wasted_, remaining_);
       remaining_ = 0;
     }
   }
@@ -201,9 +321,125 @@ void* BaseArena::GetMemoryFallback(const size_t size, const int align_as_int) {
   return reinterpret_cast<void*>(last_alloc_);
 }
 
+char* BaseArena::NewBlockMemory(const size_t size) {
+  for (size_t i = free_blocks_.size(); i > 0; --i) {
+    if (free_blocks_[i - 1].size == size) {
+      char* memory = free_blocks_[i - 1].mem;
+      free_blocks_.erase(free_blocks_.begin() + (i - 1));
+      return memory;
+    }
+  }
+  if (size == block_size_ && block_pool_) {
+    char* memory = block_pool_->Get();
+    if (memory)
+      return memory;
+  }
+  if (block_source_ != MALLOC_BLOCKS)
+    return MapBlockMemory(size);
+  char* memory;
+  if (page_aligned_) {
+    memory = reinterpret_cast<char*>(aligned_malloc(size, PageSize()));
+    PCHECK(NULL != memory);
+  } else {
+    memory = reinterpret_cast<char*>(malloc(size));
+  }
+  return memory;
+}
+
+void BaseArena::ReleaseBlockMemory(char* memory, const size_t size) {
+  if (free_blocks_.size() < max_free_blocks_ && IsRegularBlockSize(size)) {
+    if (block_source_ != MALLOC_BLOCKS) {
+      // Keep the mapping, but let the kernel take back the pages. They come
+      // back zero-filled when the block is used again.
+      madvise(memory, MapLength(size), MADV_DONTNEED);
+    }
+    AllocatedBlock block = { memory, size };
+    free_blocks_.push_back(block);
+    return;
+  }
+  if (size == block_size_ && block_pool_ && block_pool_->Put(memory))
+    return;
+  FreeBlockMemory(memory, size);
+}
+
+void BaseArena::FreeBlockMemory(char* memory, const size_t size) {
+  if (block_source_ == MALLOC_BLOCKS) {
+    free(memory);
+  } else {
+    PCHECK(munmap(memory, MapLength(size)) == 0);
+  }
+}
+
+size_t BaseArena::MapLength(const size_t size) const {
+  if (block_source_ == HUGE_PAGE_BLOCKS || block_source_ == HUGETLB_BLOCKS)
+    return RoundUp(size, kHugePageSize);
+  return RoundUp(size, PageSize());
+}
+
+char* BaseArena::MapBlockMemory(const size_t size) {
+  const size_t length = MapLength(size);
+  if (block_source_ == HUGETLB_BLOCKS) {
+    void* memory = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (memory != MAP_FAILED)
+      return reinterpret_cast<char*>(memory);
+    // No huge pages reserved: fall back to transparent huge pages, which
+    // use the same mapping length.
+  }
+  if (block_source_ == MMAP_BLOCKS) {
+    void* memory = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    PCHECK(memory != MAP_FAILED);
+    return reinterpret_cast<char*>(memory);
+  }
+
+  // Transparent huge pages only back huge-page-aligned ranges, so map an
+  // extra huge page and trim the mapping to an aligned one.
+  char* memory = reinterpret_cast<char*>(
+      mmap(NULL, length + kHugePageSize, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  PCHECK(memory != MAP_FAILED);
+  char* aligned = reinterpret_cast<char*>(
+      RoundUp(reinterpret_cast<uintptr_t>(memory), kHugePageSize));
+  if (aligned > memory)
+    munmap(memory, aligned - memory);
+  munmap(aligned + length, memory + kHugePageSize - aligned);
+  madvise(aligned, length, MADV_HUGEPAGE);
+  return aligned;
+}
+
+void BaseArena::set_block_source(BlockSource source) {
+  CHECK(is_empty());
+  CHECK(source == MALLOC_BLOCKS || block_pool_ == NULL)
+      << "Block pools only hold malloc'd blocks";
+  CHECK(source == MALLOC_BLOCKS || first_block_we_own_ == 0)
+      << "The first block was supplied by the caller";
+  if (source == block_source_)
+    return;
+  // Give back everything the old source handed out, then start over.
+  for (size_t i = 0; i < free_blocks_.size(); ++i)
+    FreeBlockMemory(free_blocks_[i].mem, free_blocks_[i].size);
+  free_blocks_.clear();
+  if (first_block_we_own_ == 0)
+    FreeBlockMemory(first_blocks_[0].mem, first_blocks_[0].size);
+  block_source_ = source;
+  if (first_block_we_own_ == 0)
+    first_blocks_[0].mem = NewBlockMemory(first_blocks_[0].size);
+  Reset();
+}
+
+void BaseArena::set_block_recycling(size_t max_free_blocks) {
+  max_free_blocks_ = max_free_blocks;
+  while (free_blocks_.size() > max_free_blocks_) {
+    AllocatedBlock block = free_blocks_.back();
+    free_blocks_.pop_back();
+    ReleaseBlockMemory(block.mem, block.size);
+  }
+}
+
 void BaseArena::FreeBlocks() {
   for ( int i = 1; i < blocks_alloced_; ++i ) {  // keep first block alloced
-    free(first_blocks_[i].mem);
+    ReleaseBlockMemory(first_blocks_[i].mem, first_blocks_[i].size);
     first_blocks_[i].mem = NULL;
     first_blocks_[i].size = 0;
   }
@@ -211,16 +447,37 @@ void BaseArena::FreeBlocks() {
   if (overflow_blocks_ != NULL) {
     vector<AllocatedBlock>::iterator it;
     for (it = overflow_blocks_->begin(); it != overflow_blocks_->end(); ++it) {
-      free(it->mem);
+      ReleaseBlockMemory(it->mem, it->size);
     }
     delete overflow_blocks_;             // These should be used very rarely
     overflow_blocks_ = NULL;
   }
+  StoreCounter(&block_count_, 1);
+}
+
+void BaseArena::AddCleanup(void* object, void (*destroy)(void*)) {
+  CleanupNode* node = reinterpret_cast<CleanupNode*>(
+      GetMemory(sizeof(CleanupNode), sizeof(void*)));
+  node->object = object;
+  node->destroy = destroy;
+  node->next = cleanups_;
+  cleanups_ = node;
+  ++cleanup_count_;
+}
+
+void BaseArena::RunCleanups() {
+  while (cleanups_ != NULL) {
+    CleanupNode* node = cleanups_;
+    cleanups_ = node->next;
+    --cleanup_count_;
+    node->destroy(node->object);
+  }
 }
 
 bool BaseArena::AdjustLastAlloc(void *last_alloc, const size_t newsize) {
   if (last_alloc == NULL || last_alloc != last_alloc_)  return false;
-  assert(freestart_ >= last_alloc_ && freestart_ <= last_alloc_ + block_size_);
+  assert(freestart_ >= last_alloc_ &&
+         freestart_ <= last_alloc_ + max_block_size_);
   assert(remaining_ >= 0);   // should be: it's a size_t!
   if (newsize > (freestart_ - last_alloc_) + remaining_)
     return false;  // not enough room, even after we get back last_alloc_ space
@@ -245,7 +502,7 @@ void* BaseArena::GetMemoryWithHandle(
   CHECK_GE(block_index, 0) << "Failed to find block that was allocated from";
   CHECK(block != NULL) << "Failed to find block that was allocated from";
   const uint64_t offset = reinterpret_cast<char*>(p) - block->mem;
-  DCHECK_LT(offset, block_size_);
+  DCHECK_LT(offset, static_cast<uint64_t>(1) << block_size_bits_);
   DCHECK((offset & ((1 << handle_alignment_bits_) - 1)) == 0);
   DCHECK((block_size_ & ((1 << handle_alignment_bits_) - 1)) == 0);
   uint64_t handle_value =
@@ -277,7 +534,8 @@ void* BaseArena::HandleToPointer(const Handle& h) const {
   uint64_t handle = static_cast<uint64_t>(h.handle_) << handle_alignment_bits_;
   int block_index = static_cast<int>(handle >> block_size_bits_);
   size_t block_offset =
-      static_cast<size_t>(handle & ((1 << block_size_bits_) - 1));
+      static_cast<size_t>(handle &
+                          ((static_cast<uint64_t>(1) << block_size_bits_) - 1));
   const AllocatedBlock* block = IndexToBlock(block_index);
   CHECK(block != NULL);
   return reinterpret_cast<void*>(block->mem + block_offset);
@@ -295,9 +553,30 @@ char* UnsafeArena::Realloc(char* s, size_t oldsize, size_t newsize) {
   return newstr;
 }
 
+char* UnsafeArena::ReallocAligned(char* s, size_t oldsize, size_t newsize,
+                                  const int align) {
+  if ( AdjustLastAlloc(s, newsize) )             // in case s was last alloc
+    return s;
+  if ( s != NULL && newsize <= oldsize ) {
+    return s;
+  }
+  char * newstr = reinterpret_cast<char*>(AllocAligned(newsize, align));
+  if ( s != NULL )
+    memcpy(newstr, s, min(oldsize, newsize));
+  return newstr;
+}
+
+void SafeArena::Reset() {
+  // Destructors may Free() into the arena, so they run without the lock.
+  // Nothing may allocate from the arena while it is being reset anyway.
+  RunCleanups();
+  LockGuard<FutexMutex> lock(&mutex_);
+  BaseArena::Reset();
+}
+
 char* SafeArena::Realloc(char* s, size_t oldsize, size_t newsize) {
   assert(oldsize >= 0 && newsize >= 0);
-  { LockGuard<Mutex> lock(&mutex_);
+  { LockGuard<FutexMutex> lock(&mutex_);
     if ( AdjustLastAlloc(s, newsize) )           // in case s was last alloc
       return s;
   }
@@ -309,4 +588,137 @@ char* SafeArena::Realloc(char* s, size_t oldsize, size_t newsize) {
   return newstr;
 }
 
+char* SafeArena::ReallocAligned(char* s, size_t oldsize, size_t newsize,
+                                const int align) {
+  { LockGuard<FutexMutex> lock(&mutex_);
+    if ( AdjustLastAlloc(s, newsize) )           // in case s was last alloc
+      return s;
+  }
+  if ( s != NULL && newsize <= oldsize ) {
+    return s;
+  }
+  char * newstr = reinterpret_cast<char*>(AllocAligned(newsize, align));
+  if ( s != NULL )
+    memcpy(newstr, s, min(oldsize, newsize));
+  return newstr;
+}
+
+static_assert(sizeof(size_t) == sizeof(Atomic64),
+              "Arena counters are stored as Atomic64");
+
+static LazyMutex live_arenas_mutex = LAZY_MUTEX_INITIALIZER;
+// Named arenas, linked through prev_live_ and next_live_.
+static BaseArena* live_arenas = NULL;
+
+void BaseArena::set_name(const char* name) {
+  LockGuard<Mutex> lock(live_arenas_mutex.Pointer());
+  name_ = name;
+  if (registered_)
+    return;
+  registered_ = true;
+  prev_live_ = NULL;
+  next_live_ = live_arenas;
+  if (live_arenas)
+    live_arenas->prev_live_ = this;
+  live_arenas = this;
+}
+
+void BaseArena::UnregisterArena() {
+  if (!registered_)
+    return;
+  LockGuard<Mutex> lock(live_arenas_mutex.Pointer());
+  if (prev_live_)
+    prev_live_->next_live_ = next_live_;
+  else
+    live_arenas = next_live_;
+  if (next_live_)
+    next_live_->prev_live_ = prev_live_;
+  prev_live_ = NULL;
+  next_live_ = NULL;
+  registered_ = false;
+}
+
+BaseArena::Status BaseArena::LoadStatus() const {
+  Status status;
+  status.bytes_allocated_ = LoadCounter(&status_.bytes_allocated_);
+  status.bytes_requested_ = LoadCounter(&status_.bytes_requested_);
+  status.bytes_wasted_ = LoadCounter(&status_.bytes_wasted_);
+  status.oversize_blocks_ = LoadCounter(&status_.oversize_blocks_);
+  status.oversize_bytes_ = LoadCounter(&status_.oversize_bytes_);
+  status.peak_bytes_allocated_ = LoadCounter(&status_.peak_bytes_allocated_);
+  status.peak_bytes_requested_ = LoadCounter(&status_.peak_bytes_requested_);
+  status.reset_count_ = LoadCounter(&status_.reset_count_);
+  for (int i = 0; i < Status::kHistogramBuckets; ++i)
+    status.reset_histogram_[i] = LoadCounter(&status_.reset_histogram_[i]);
+  return status;
+}
+
+// static
+void BaseArena::GetLiveArenas(std::vector<LiveArena>* arenas) {
+  arenas->clear();
+  LockGuard<Mutex> lock(live_arenas_mutex.Pointer());
+  for (BaseArena* arena = live_arenas; arena; arena = arena->next_live_) {
+    // A named SafeArena unregisters before its mutex goes away.
+    FutexMutex* status_mutex = arena->status_mutex_;
+    if (status_mutex)
+      status_mutex->Lock();
+    LiveArena live;
+    live.name = arena->name_;
+    live.block_size = arena->block_size_;
+    live.block_count = static_cast<int>(LoadCounter(&arena->block_count_));
+    live.status = arena->LoadStatus();
+    if (status_mutex)
+      status_mutex->Unlock();
+    arenas->push_back(live);
+  }
+}
+
+ArenaBlockPool::ArenaBlockPool(size_t block_size, size_t max_free_blocks,
+                               bool page_aligned)
+  : block_size_(block_size),
+    max_free_blocks_(max_free_blocks),
+    page_aligned_(page_aligned) {
+}
+
+ArenaBlockPool::~ArenaBlockPool() {
+  for (size_t i = 0; i < blocks_.size(); ++i)
+    free(blocks_[i]);
+}
+
+char* ArenaBlockPool::Get() {
+  LockGuard<Mutex> lock(&mutex_);
+  if (blocks_.empty())
+    return NULL;
+  char* block = blocks_.back();
+  blocks_.pop_back();
+  return block;
+}
+
+bool ArenaBlockPool::Put(char* block) {
+  LockGuard<Mutex> lock(&mutex_);
+  if (blocks_.size() >= max_free_blocks_)
+    return false;
+  blocks_.push_back(block);
+  return true;
+}
+
+size_t ArenaBlockPool::free_block_count() {
+  LockGuard<Mutex> lock(&mutex_);
+  return blocks_.size();
+}
+
+static LazyMutex shared_pools_mutex = LAZY_MUTEX_INITIALIZER;
+
+// static
+ArenaBlockPool* ArenaBlockPool::Shared(size_t block_size) {
+  static std::map<size_t, ArenaBlockPool*>* pools = NULL;
+  LockGuard<Mutex> lock(shared_pools_mutex.Pointer());
+  if (pools == NULL)
+    pools = new std::map<size_t, ArenaBlockPool*>;
+  ArenaBlockPool*& pool = (*pools)[block_size];
+  if (pool == NULL)
+    pool = new ArenaBlockPool(block_size, kSharedPoolMaxFreeBlocks);
+  return pool;
+}
+
 }
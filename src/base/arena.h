@@ -1,18 +1,28 @@
 #ifndef MRPC_BASE_ARENA_H_
 #define MRPC_BASE_ARENA_H_
 
+#include "base/atomicops.h"
+#include "base/futex_mutex.h"
 #include "base/mutex.h"
 #include "base/macros.h"
 #include <assert.h>
 #include <string.h>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace mrpc {
 
+class ArenaBlockPool;
+
 class BaseArena {
  protected:
   BaseArena(char* first_block, const size_t block_size, 
             bool align_to_page);
+  // Takes every full-size block, including the first, from |pool| and
+  // gives them back to it. |pool| must outlive the arena.
+  BaseArena(ArenaBlockPool* pool, bool align_to_page);
 
  public:
   virtual ~BaseArena();
@@ -31,23 +41,88 @@ class BaseArena {
     uint32_t hash() const { return handle_; }
     bool valid() const { return handle_ != kInvalidValue; }
 
+    // The raw value, and a handle rebuilt from it, for handles that travel
+    // to another process.
+    uint32_t value() const { return handle_; }
+    static Handle FromValue(uint32_t value) { return Handle(value); }
+
    private:
     friend class BaseArena;
     explicit Handle(uint32_t handle) : handle_(handle) {}
     uint32_t handle_;
   };
+  // Where an arena's memory went. Everything but the peaks and the Reset()
+  // histogram covers the time since the last Reset().
   class Status {
    public:
-    Status() : bytes_allocated_(0) {}
+    static const int kHistogramBuckets = 32;
+
+    Status()
+      : bytes_allocated_(0), bytes_requested_(0), bytes_wasted_(0),
+        oversize_blocks_(0), oversize_bytes_(0), peak_bytes_allocated_(0),
+        peak_bytes_requested_(0), reset_count_(0) {
+      memset(reset_histogram_, 0, sizeof(reset_histogram_));
+    }
 
+    // Capacity of the blocks the arena holds.
     size_t bytes_allocated() const {
       return bytes_allocated_;
     }
+    // Bytes asked for, before alignment.
+    size_t bytes_requested() const { return bytes_requested_; }
+    // Alignment padding, plus block tails left behind when a request did
+    // not fit and a new block was started.
+    size_t bytes_wasted() const { return bytes_wasted_; }
+    // Requests over the cutoff that got a block of their own.
+    size_t oversize_blocks() const { return oversize_blocks_; }
+    size_t oversize_bytes() const { return oversize_bytes_; }
+    // Highest values over the arena's lifetime.
+    size_t peak_bytes_allocated() const {
+      return peak_bytes_allocated_ > bytes_allocated_ ? peak_bytes_allocated_
+                                                      : bytes_allocated_;
+    }
+    size_t peak_bytes_requested() const {
+      return peak_bytes_requested_ > bytes_requested_ ? peak_bytes_requested_
+                                                      : bytes_requested_;
+    }
+    size_t reset_count() const { return reset_count_; }
+    // How many Reset() cycles requested 0 bytes (bucket 0), or between
+    // 2^(i-1) and 2^i - 1 bytes (bucket i). The last bucket has the rest.
+    size_t reset_histogram(int bucket) const {
+      return reset_histogram_[bucket];
+    }
 
    private:
     friend class BaseArena;
     size_t bytes_allocated_; 
+    size_t bytes_requested_;
+    size_t bytes_wasted_;
+    size_t oversize_blocks_;
+    size_t oversize_bytes_;
+    size_t peak_bytes_allocated_;
+    size_t peak_bytes_requested_;
+    size_t reset_count_;
+    size_t reset_histogram_[kHistogramBuckets];
+  };
+
+  // A snapshot of a live arena, from GetLiveArenas().
+  struct LiveArena {
+    const char* name;
+    size_t block_size;
+    int block_count;
+    Status status;
   };
+  // Every arena that has been given a name. SafeArenas are read under their
+  // lock. An UnsafeArena may be in use on its own thread meanwhile; its
+  // counters are written with relaxed atomic stores, so each one is read
+  // whole, though they may not all be from the same moment.
+  static void GetLiveArenas(std::vector<LiveArena>* arenas);
+
+  // Labels the arena and lists it in GetLiveArenas() until it is destroyed.
+  // Arenas that are never named stay out of the registry and never take its
+  // lock. |name| must outlive the arena.
+  void set_name(const char* name);
+  const char* name() const { return name_; }
    
   virtual char* SlowAlloc(size_t size) = 0;
   virtual void  SlowFree(void* memory, size_t size) = 0;
@@ -55,13 +130,53 @@ class BaseArena {
 		            size_t old_size, 
 		            size_t new_size) = 0;
   virtual char* SlowAllocWithHandle(const size_t size, Handle* handle) = 0;
+  // Like SlowRealloc, but a moved allocation keeps |align|. |memory| may be
+  // NULL, in which case this is an aligned allocation.
+  virtual char* SlowReallocAligned(char* memory,
+                                   size_t old_size,
+                                   size_t new_size,
+                                   const int align) = 0;
 
   void set_handle_alignment(int align);
   void* HandleToPointer(const Handle& h) const;
 
+  // Objects made with Create() whose destructors are still to run.
+  size_t cleanup_count() const { return cleanup_count_; }
+
+  // Keeps up to |max_free_blocks| regular blocks that Reset() retires on a
+  // free list for the next blocks, instead of freeing and mallocing them
+  // again. Blocks past the mark go to the block pool, if any, or are freed.
+  void set_block_recycling(size_t max_free_blocks);
+
+  // Where blocks come from. The mmap sources return regular blocks that
+  // Reset() keeps for recycling to the OS with madvise(MADV_DONTNEED), and
+  // unmap the rest.
+  enum BlockSource {
+    MALLOC_BLOCKS,
+    // Anonymous private mappings.
+    MMAP_BLOCKS,
+    // Huge-page-aligned mappings advised with MADV_HUGEPAGE, for
+    // transparent huge pages.
+    HUGE_PAGE_BLOCKS,
+    // MAP_HUGETLB mappings from the reserved huge page pool, falling back to
+    // HUGE_PAGE_BLOCKS when none are available.
+    HUGETLB_BLOCKS,
+  };
+  // The arena must be empty, own its first block and have no block pool.
+  void set_block_source(BlockSource source);
+  BlockSource block_source() const { return block_source_; }
+
+  // Makes each new block |multiplier| times the size of the one before,
+  // starting from block_size() and stopping at |max_block_size|. Requests
+  // over a quarter of the next block's size still get a block of their
+  // own. The arena must be empty. Growth starts over on Reset().
+  void set_block_growth(int multiplier, size_t max_block_size);
+  size_t free_block_count() const { return free_blocks_.size(); }
+
   virtual BaseArena* arena() { return this; }
   size_t block_size() const { return block_size_; }
-  int block_count() const;
+  size_t next_block_size() const { return next_block_size_; }
+  int block_count() const { return static_cast<int>(block_count_); }
   bool is_empty() const {
     return freestart_ == freestart_when_empty_ && 1 == block_count();
   }
@@ -76,7 +191,8 @@ class BaseArena {
   void* GetMemoryFallback(const size_t size, const int align);
 
   void* GetMemory(const size_t size, const int align) {
-    assert(remaining_ <= block_size_);
+    assert(remaining_ <= max_block_size_);
+    AddToCounter(&status_.bytes_requested_, size);
     if (size > 0 && size < remaining_ && align == 1) {
       last_alloc_ = freestart_;
       freestart_ += size;
@@ -98,6 +214,44 @@ class BaseArena {
   bool AdjustLastAlloc(void* last_alloc, const size_t new_size);
   void* GetMemoryWithHandle(const size_t size, Handle* handle);
 
+  // Has Reset() and the destructor run |destroy(object)|, last added first.
+  // The bookkeeping lives in the arena itself.
+  void AddCleanup(void* object, void (*destroy)(void*));
+  // Runs the cleanups, including any that they add themselves.
+  void RunCleanups();
+
+  // Has GetLiveArenas() hold |mutex| while it reads this arena. Called
+  // before the arena can be named, so the registry never sees it change.
+  void SetStatusMutex(FutexMutex* mutex) { status_mutex_ = mutex; }
+  // Takes the arena out of the registry, if it was named. An arena with a
+  // status mutex must do this before the mutex is destroyed.
+  void UnregisterArena();
+
+  // Status counters and block_count_ are only written by the thread using
+  // the arena, with relaxed stores, so that GetLiveArenas() can read them.
+  static void StoreCounter(size_t* counter, size_t value) {
+    NoBarrier_Store(reinterpret_cast<volatile Atomic64*>(counter),
+                    static_cast<Atomic64>(value));
+  }
+  static void AddToCounter(size_t* counter, size_t value) {
+    StoreCounter(counter, *counter + value);
+  }
+  static size_t LoadCounter(const size_t* counter) {
+    return static_cast<size_t>(
+        NoBarrier_Load(reinterpret_cast<volatile const Atomic64*>(counter)));
+  }
+
+  template <typename T>
+  static void DestroyObject(void* object) {
+    static_cast<T*>(object)->~T();
+  }
+  template <typename T>
+  void AddCleanupFor(T* object, std::false_type /* trivially destructible */) {
+    AddCleanup(object, &DestroyObject<T>);
+  }
+  template <typename T>
+  void AddCleanupFor(T* /* object */, std::true_type) {}
+
   Status status_;
   size_t remaining_;
 
@@ -106,8 +260,29 @@ class BaseArena {
     char* mem;
     size_t size;
   };
+  struct CleanupNode {
+    void* object;
+    void (*destroy)(void*);
+    CleanupNode* next;
+  };
   AllocatedBlock* AllocNewBlock(const size_t block_size);
   const AllocatedBlock* IndexToBlock(int index) const;
+  // Get and give back the memory behind a block, through the free list and
+  // block pool when it is a full-size block.
+  char* NewBlockMemory(const size_t size);
+  void Init(char* first_block);
+  // True for the sizes that MakeNewBlock() can pick, as opposed to blocks
+  // made for a single oversize request.
+  bool IsRegularBlockSize(size_t size) const;
+  void FreeBlockMemory(char* memory, const size_t size);
+  // Files this cycle's requests in the histogram and starts a new cycle.
+  void RecordReset();
+  // Reads status_ with LoadCounter().
+  Status LoadStatus() const;
+  // mmap'd blocks of |size| bytes take this much address space.
+  size_t MapLength(const size_t size) const;
+  char* MapBlockMemory(const size_t size);
+  void ReleaseBlockMemory(char* memory, const size_t size);
 
   const int first_block_we_own_;
   const size_t block_size_;
@@ -115,12 +290,31 @@ class BaseArena {
   char* freestart_when_empty_;
   char* last_alloc_;
   int blocks_alloced_;
+  // blocks_alloced_ plus the overflow blocks.
+  size_t block_count_;
   AllocatedBlock first_blocks_[16];
   std::vector<AllocatedBlock>* overflow_blocks_;
   const bool page_aligned_;
   int handle_alignment_;
   int handle_alignment_bits_;
+  // Handles address offsets up to the largest regular block.
   size_t block_size_bits_;
+  size_t next_block_size_;
+  size_t max_block_size_;
+  int growth_multiplier_;
+  BlockSource block_source_;
+  std::vector<AllocatedBlock> free_blocks_;
+  size_t max_free_blocks_;
+  ArenaBlockPool* block_pool_;
+  CleanupNode* cleanups_;
+  size_t cleanup_count_;
+  const char* name_;
+  FutexMutex* status_mutex_;
+  // Links in the registry of named arenas, protected by its lock.
+  // |registered_| is only touched by the thread that owns the arena.
+  bool registered_;
+  BaseArena* prev_live_;
+  BaseArena* next_live_;
   void FreeBlocks();
 
   //
@@ -139,6 +333,8 @@ class UnsafeArena : public BaseArena {
     : BaseArena(first_block, block_size, false) {}
   UnsafeArena(char* first_block, const size_t block_size, bool align)
     : BaseArena(first_block, block_size, align) {}
+  explicit UnsafeArena(ArenaBlockPool* pool)
+    : BaseArena(pool, false) {}
 
   char* Alloc(const size_t size) {
     return reinterpret_cast<char*>(GetMemory(size, 1));
@@ -161,6 +357,17 @@ class UnsafeArena : public BaseArena {
   void Free(void* memory, size_t size) {
     ReturnMemory(memory, size);
   }
+
+  // Constructs a T in the arena. Unless T is trivially destructible, its
+  // destructor runs on Reset() or when the arena is destroyed, in reverse
+  // order of creation.
+  template <typename T, typename... Args>
+  T* Create(Args&&... args) {
+    T* object = new (AllocAligned(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+    AddCleanupFor(object, std::is_trivially_destructible<T>());
+    return object;
+  }
   typedef BaseArena::Handle Handle;
   char* AllocWithHandle(const size_t size, Handle* handle) {
     return reinterpret_cast<char*>(GetMemoryWithHandle(size, handle));
@@ -180,6 +387,11 @@ class UnsafeArena : public BaseArena {
 		                    Handle* handle) override {
     return AllocWithHandle(size, handle);
   }
+  virtual char* SlowReallocAligned(char* memory, size_t old_size,
+                                   size_t new_size,
+                                   const int align) override {
+    return ReallocAligned(memory, old_size, new_size, align);
+  }
 
   char* Memdup(const char* s, size_t bytes) {
     char* new_str = Alloc(bytes);
@@ -210,6 +422,8 @@ class UnsafeArena : public BaseArena {
   }
 
   char* Realloc(char* s, size_t old_size, size_t new_size);
+  char* ReallocAligned(char* s, size_t old_size, size_t new_size,
+                       const int align);
   char* Shrink(char* s, size_t new_size) {
     AdjustLastAlloc(s, new_size);
     return s;
@@ -224,23 +438,29 @@ class UnsafeArena : public BaseArena {
 class SafeArena : public BaseArena {
  public:
   explicit SafeArena(const size_t block_size)
-    : BaseArena(nullptr, block_size, false) { }
+    : BaseArena(nullptr, block_size, false) { SetStatusMutex(&mutex_); }
 
   SafeArena(char* first_block, const size_t block_size)
-    : BaseArena(first_block, block_size, false) { }
+    : BaseArena(first_block, block_size, false) { SetStatusMutex(&mutex_); }
+
+  explicit SafeArena(ArenaBlockPool* pool)
+    : BaseArena(pool, false) { SetStatusMutex(&mutex_); }
 
-  virtual void Reset() override { // Lock
-    LockGuard<Mutex> lock(&mutex_);
-    BaseArena::Reset();
+  // Runs the cleanups while |mutex_| is still alive for them to Free().
+  virtual ~SafeArena() {
+    RunCleanups();
+    UnregisterArena();
   }
 
+  virtual void Reset() override; // Lock
+
   char* Alloc(const size_t size) { // Lock
-    LockGuard<Mutex> lock(&mutex_);
+    LockGuard<FutexMutex> lock(&mutex_);
     return reinterpret_cast<char*>(GetMemory(size, 1));
   }
   // Lock
   void* AllocAligned(const size_t size, const int align) {
-    LockGuard<Mutex> lock(&mutex_);
+    LockGuard<FutexMutex> lock(&mutex_);
     return GetMemory(size, align);
   }
 
@@ -255,12 +475,22 @@ class SafeArena : public BaseArena {
     return return_value;
   }
   void Free(void* memory, size_t size) {
-    LockGuard<Mutex> lock(&mutex_);
+    LockGuard<FutexMutex> lock(&mutex_);
     ReturnMemory(memory, size);
   }
+
+  // Like UnsafeArena::Create(). T's constructor runs outside the lock.
+  template <typename T, typename... Args>
+  T* Create(Args&&... args) {
+    T* object = new (AllocAligned(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+    LockGuard<FutexMutex> lock(&mutex_);
+    AddCleanupFor(object, std::is_trivially_destructible<T>());
+    return object;
+  }
   typedef BaseArena::Handle Handle;
   char* AllocWithHandle(const size_t size, Handle* handle) {
-    LockGuard<Mutex> lock(&mutex_);
+    LockGuard<FutexMutex> lock(&mutex_);
     return reinterpret_cast<char*>(GetMemoryWithHandle(size, handle));
   }
 
@@ -280,6 +510,11 @@ class SafeArena : public BaseArena {
 		                    Handle* handle) override {
     return AllocWithHandle(size, handle);
   }
+  virtual char* SlowReallocAligned(char* memory, size_t old_size,
+                                   size_t new_size,
+                                   const int align) override {
+    return ReallocAligned(memory, old_size, new_size, align);
+  }
 
   char* Memdup(const char* s, size_t bytes) {
     char* newstr = Alloc(bytes);
@@ -313,28 +548,66 @@ class SafeArena : public BaseArena {
 
 
   char* Realloc(char* s, size_t old_size, size_t new_size);
+  char* ReallocAligned(char* s, size_t old_size, size_t new_size,
+                       const int align);
 
   char* Shrink(char* s, size_t new_size) {
-    LockGuard<Mutex> lock(&mutex_);
+    LockGuard<FutexMutex> lock(&mutex_);
     AdjustLastAlloc(s, new_size);
     return s;
   } 
 
   Status status() {
-    LockGuard<Mutex> lock(&mutex_);
+    LockGuard<FutexMutex> lock(&mutex_);
     return status_;
   }
 
   size_t bytes_until_next_allocation() {
-    LockGuard<Mutex> lock(&mutex_);
+    LockGuard<FutexMutex> lock(&mutex_);
     return remaining_;
   }
 
  protected:
-  Mutex mutex_;
+  // Alloc() holds it only briefly, so it spins before it sleeps.
+  FutexMutex mutex_;
  private:
   DISALLOW_COPY_AND_ASSIGN(SafeArena);
 };
 
+// A thread-safe free list of arena blocks of one size, shared by arenas with
+// that block size so that short-lived arenas, such as one per request, do
+// not malloc and free their blocks over and over.
+class ArenaBlockPool {
+ public:
+  // Keeps at most |max_free_blocks| blocks; any more are freed.
+  ArenaBlockPool(size_t block_size, size_t max_free_blocks,
+                 bool page_aligned = false);
+  ~ArenaBlockPool();
+
+  // Returns nullptr when the pool is empty.
+  char* Get();
+  // Returns false, leaving |block| to the caller, when the pool is full.
+  bool Put(char* block);
+
+  size_t block_size() const { return block_size_; }
+  bool page_aligned() const { return page_aligned_; }
+  size_t free_block_count();
+
+  // A process-wide pool for arenas of |block_size| byte blocks, holding up
+  // to kSharedPoolMaxFreeBlocks of them. Never destroyed.
+  static ArenaBlockPool* Shared(size_t block_size);
+
+  static const size_t kSharedPoolMaxFreeBlocks = 64;
+
+ private:
+  const size_t block_size_;
+  const size_t max_free_blocks_;
+  const bool page_aligned_;
+  Mutex mutex_;
+  std::vector<char*> blocks_;
+
+  DISALLOW_COPY_AND_ASSIGN(ArenaBlockPool);
+};
+
 } // namespace mrpc
 #endif // MRPC_BASE_ARENA_H_
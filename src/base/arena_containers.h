@@ -0,0 +1,98 @@
+#ifndef MRPC_BASE_ARENA_CONTAINERS_H_
+#define MRPC_BASE_ARENA_CONTAINERS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "base/arena.h"
+
+namespace mrpc {
+
+// A C++11 allocator that takes memory from an arena of type C: UnsafeArena,
+// SafeArena, ConcurrentArena, or anything else with AllocAligned().
+//
+// Unlike ArenaAllocator, deallocate() does nothing, so containers never
+// touch a SafeArena's lock when they grow or shrink; memory comes back on
+// the arena's Reset(). Containers must be destroyed, or abandoned if their
+// elements are trivially destructible, before that Reset().
+template <typename T, typename C = UnsafeArena>
+class ArenaStlAllocator {
+ public:
+  typedef T value_type;
+  typedef std::true_type propagate_on_container_copy_assignment;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  explicit ArenaStlAllocator(C* arena) : arena_(arena) {}
+  template <typename U>
+  ArenaStlAllocator(const ArenaStlAllocator<U, C>& other)  // NOLINT
+    : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(arena_->AllocAligned(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T* /* p */, size_t /* n */) {}
+
+  C* arena() const { return arena_; }
+
+  template <typename U>
+  struct rebind {
+    typedef ArenaStlAllocator<U, C> other;
+  };
+
+ private:
+  C* arena_;
+};
+
+template <typename T, typename U, typename C>
+bool operator==(const ArenaStlAllocator<T, C>& a,
+                const ArenaStlAllocator<U, C>& b) {
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U, typename C>
+bool operator!=(const ArenaStlAllocator<T, C>& a,
+                const ArenaStlAllocator<U, C>& b) {
+  return a.arena() != b.arena();
+}
+
+template <typename T, typename C = UnsafeArena>
+using ArenaVector = std::vector<T, ArenaStlAllocator<T, C> >;
+
+template <typename C>
+using BasicArenaString =
+    std::basic_string<char, std::char_traits<char>, ArenaStlAllocator<char, C> >;
+typedef BasicArenaString<UnsafeArena> ArenaString;
+
+// std::hash only covers strings with the default allocator.
+struct ArenaStringHash {
+  template <typename C>
+  size_t operator()(const BasicArenaString<C>& s) const {
+    // 64-bit FNV-1a.
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < s.size(); ++i) {
+      hash ^= static_cast<unsigned char>(s[i]);
+      hash *= 1099511628211ULL;
+    }
+    return static_cast<size_t>(hash);
+  }
+};
+
+// Buckets and nodes both come from the arena.
+template <typename K, typename V, typename C = UnsafeArena,
+          typename Hash = typename std::conditional<
+              std::is_same<K, BasicArenaString<C> >::value,
+              ArenaStringHash, std::hash<K> >::type,
+          typename Equal = std::equal_to<K> >
+using ArenaUnorderedMap =
+    std::unordered_map<K, V, Hash, Equal,
+                       ArenaStlAllocator<std::pair<const K, V>, C> >;
+
+} // namespace mrpc
+#endif // MRPC_BASE_ARENA_CONTAINERS_H_
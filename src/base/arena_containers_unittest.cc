@@ -0,0 +1,91 @@
+#include "base/arena_containers.h"
+#include <gtest/gtest.h>
+
+#include "base/concurrent_arena.h"
+
+using namespace mrpc;
+
+namespace {
+
+const size_t kBlockSize = 4096;
+
+// Move-only, so that only emplace and move can put it in a container.
+class Token {
+ public:
+  explicit Token(int value) : value_(value) {}
+  Token(Token&& other) : value_(other.value_) { other.value_ = -1; }
+  Token& operator=(Token&& other) {
+    value_ = other.value_;
+    other.value_ = -1;
+    return *this;
+  }
+
+  int value() const { return value_; }
+
+ private:
+  int value_;
+
+  DISALLOW_COPY_AND_ASSIGN(Token);
+};
+
+} // namespace
+
+TEST(ArenaContainersTest, VectorOfMoveOnlyTypes) {
+  UnsafeArena arena(kBlockSize);
+  ArenaVector<Token> tokens((ArenaStlAllocator<Token>(&arena)));
+  for (int i = 0; i < 1000; ++i)
+    tokens.emplace_back(i);
+  tokens.push_back(Token(1000));
+  ASSERT_EQ(1001u, tokens.size());
+  for (int i = 0; i <= 1000; ++i)
+    EXPECT_EQ(i, tokens[i].value());
+  EXPECT_GE(arena.status().bytes_requested(), 1001 * sizeof(Token));
+}
+
+TEST(ArenaContainersTest, AlignedElements) {
+  UnsafeArena arena(kBlockSize);
+  arena.Alloc(1);
+  ArenaVector<double> values((ArenaStlAllocator<double>(&arena)));
+  for (int i = 0; i < 5000; ++i) {
+    values.push_back(i * 0.5);
+    ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(values.data()) % alignof(double));
+  }
+}
+
+TEST(ArenaContainersTest, Strings) {
+  UnsafeArena arena(kBlockSize);
+  ArenaString s((ArenaStlAllocator<char>(&arena)));
+  for (int i = 0; i < 100; ++i)
+    s.append("abcdefghij");
+  EXPECT_EQ(1000u, s.size());
+  EXPECT_EQ("abcdefghij", std::string(s.data() + 990, 10));
+
+  ArenaString copy(s);
+  EXPECT_EQ(&arena, copy.get_allocator().arena());
+  EXPECT_TRUE(copy == s);
+}
+
+TEST(ArenaContainersTest, UnorderedMapWithStringKeys) {
+  SafeArena arena(kBlockSize);
+  typedef BasicArenaString<SafeArena> Key;
+  ArenaStlAllocator<char, SafeArena> allocator(&arena);
+  ArenaUnorderedMap<Key, int, SafeArena> map(
+      16, ArenaStringHash(), std::equal_to<Key>(), allocator);
+  for (int i = 0; i < 500; ++i)
+    map.emplace(Key(std::to_string(i).c_str(), allocator), i);
+  ASSERT_EQ(500u, map.size());
+  EXPECT_EQ(123, map.find(Key("123", allocator))->second);
+  EXPECT_TRUE(map.find(Key("500", allocator)) == map.end());
+  EXPECT_GT(arena.status().bytes_requested(), 500 * sizeof(Key));
+}
+
+TEST(ArenaContainersTest, ConcurrentArena) {
+  ConcurrentArena arena(64 * 1024);
+  ArenaUnorderedMap<int, int, ConcurrentArena> map(
+      8, std::hash<int>(), std::equal_to<int>(),
+      ArenaStlAllocator<int, ConcurrentArena>(&arena));
+  for (int i = 0; i < 1000; ++i)
+    map[i] = i * i;
+  EXPECT_EQ(81, map[9]);
+  EXPECT_GT(arena.status().bytes_requested(), 1000u);
+}
@@ -0,0 +1,421 @@
+#include "base/arena.h"
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "base/thread.h"
+
+using namespace mrpc;
+
+namespace {
+
+const size_t kBlockSize = 1024;
+
+// Fills |arena| until it holds |blocks| blocks and returns their addresses.
+std::set<char*> FillBlocks(UnsafeArena* arena, int blocks) {
+  std::set<char*> starts;
+  while (arena->block_count() < blocks) {
+    int before = arena->block_count();
+    char* memory = arena->Alloc(kBlockSize / 8);
+    if (arena->block_count() != before)
+      starts.insert(memory);
+  }
+  return starts;
+}
+
+// Allocates |count| 16-byte pieces from |arena|.
+class AllocThread : public Thread {
+ public:
+  AllocThread(BaseArena* arena, int count)
+    : Thread(Options("arena_alloc")), arena_(arena), count_(count) {}
+
+  virtual void Run() override {
+    for (int i = 0; i < count_; ++i)
+      arena_->SlowAlloc(16);
+  }
+
+ private:
+  BaseArena* arena_;
+  int count_;
+};
+
+} // namespace
+
+TEST(ArenaTest, ResetFreesBlocksByDefault) {
+  UnsafeArena arena(kBlockSize);
+  FillBlocks(&arena, 4);
+  arena.Reset();
+  EXPECT_EQ(1, arena.block_count());
+  EXPECT_EQ(0u, arena.free_block_count());
+}
+
+TEST(ArenaTest, RecyclesBlocksUpToHighWaterMark) {
+  UnsafeArena arena(kBlockSize);
+  arena.set_block_recycling(2);
+  std::set<char*> first = FillBlocks(&arena, 4);
+  EXPECT_EQ(3u, first.size());
+  arena.Reset();
+  EXPECT_EQ(2u, arena.free_block_count());
+
+  // The next blocks come off the free list.
+  std::set<char*> second = FillBlocks(&arena, 3);
+  EXPECT_EQ(0u, arena.free_block_count());
+  for (std::set<char*>::iterator it = second.begin(); it != second.end();
+       ++it) {
+    EXPECT_EQ(1u, first.count(*it));
+  }
+
+  arena.set_block_recycling(0);
+  arena.Reset();
+  EXPECT_EQ(0u, arena.free_block_count());
+}
+
+TEST(ArenaTest, OversizeBlocksAreNotRecycled) {
+  UnsafeArena arena(kBlockSize);
+  arena.set_block_recycling(4);
+  FillBlocks(&arena, 2);
+  arena.Alloc(kBlockSize * 2);
+  EXPECT_EQ(3, arena.block_count());
+  arena.Reset();
+  // Only the kBlockSize one is kept.
+  EXPECT_EQ(1u, arena.free_block_count());
+}
+
+TEST(ArenaTest, BlockPoolIsSharedBetweenArenas) {
+  ArenaBlockPool pool(kBlockSize, 3);
+  std::set<char*> blocks;
+  {
+    UnsafeArena arena(&pool);
+    blocks = FillBlocks(&arena, 2);
+    blocks.insert(arena.Alloc(1));
+  }
+  // Both the first block and the one after it went back to the pool.
+  EXPECT_EQ(2u, pool.free_block_count());
+  {
+    SafeArena arena(&pool);
+    EXPECT_EQ(1u, pool.free_block_count());
+    arena.Reset();
+  }
+  EXPECT_EQ(2u, pool.free_block_count());
+
+  // Past the high-water mark, blocks are freed.
+  {
+    UnsafeArena arena(&pool);
+    FillBlocks(&arena, 5);
+  }
+  EXPECT_EQ(3u, pool.free_block_count());
+}
+
+TEST(ArenaTest, SharedPoolIsPerBlockSize) {
+  ArenaBlockPool* pool = ArenaBlockPool::Shared(kBlockSize);
+  EXPECT_EQ(pool, ArenaBlockPool::Shared(kBlockSize));
+  EXPECT_NE(pool, ArenaBlockPool::Shared(2 * kBlockSize));
+  EXPECT_EQ(kBlockSize, pool->block_size());
+}
+
+TEST(ArenaTest, BlocksGrowGeometrically) {
+  UnsafeArena arena(kBlockSize);
+  arena.set_block_growth(2, 8 * kBlockSize);
+  EXPECT_EQ(kBlockSize, arena.next_block_size());
+  size_t expected[] = { 1, 2, 4, 8, 8 };
+  for (size_t i = 0; i < ARRAYSIZE(expected); ++i) {
+    int blocks = arena.block_count();
+    while (arena.block_count() == blocks)
+      arena.Alloc(kBlockSize / 8);
+    EXPECT_EQ(std::min(2 * expected[i], static_cast<size_t>(8)) * kBlockSize,
+              arena.next_block_size());
+  }
+  // The oversize cutoff follows the block size.
+  int blocks = arena.block_count();
+  arena.Alloc(kBlockSize);
+  EXPECT_EQ(blocks, arena.block_count());
+
+  arena.Reset();
+  EXPECT_EQ(kBlockSize, arena.next_block_size());
+}
+
+TEST(ArenaTest, GrownBlocksAreRecycled) {
+  UnsafeArena arena(kBlockSize);
+  arena.set_block_growth(4, 16 * kBlockSize);
+  arena.set_block_recycling(8);
+  FillBlocks(&arena, 4);
+  arena.Alloc(64 * kBlockSize);
+  arena.Reset();
+  // The 1x, 4x and 16x blocks are kept; the oversize one is not.
+  EXPECT_EQ(3u, arena.free_block_count());
+  FillBlocks(&arena, 4);
+  EXPECT_EQ(0u, arena.free_block_count());
+}
+
+TEST(ArenaTest, HandlesSurviveGrowth) {
+  UnsafeArena arena(kBlockSize);
+  arena.set_handle_alignment(4);
+  arena.set_block_growth(2, 16 * kBlockSize);
+  std::vector<std::pair<UnsafeArena::Handle, char*> > handles;
+  for (int i = 0; i < 2000; ++i) {
+    UnsafeArena::Handle handle;
+    char* memory = arena.AllocWithHandle(1 + i % 300, &handle);
+    ASSERT_TRUE(handle.valid());
+    handles.push_back(std::make_pair(handle, memory));
+  }
+  EXPECT_GT(arena.next_block_size(), kBlockSize);
+  for (size_t i = 0; i < handles.size(); ++i)
+    EXPECT_EQ(handles[i].second, arena.HandleToPointer(handles[i].first));
+}
+
+TEST(ArenaTest, PageAlignedBlocksUseSystemPageSize) {
+  const size_t page_size = getpagesize();
+  UnsafeArena arena(4 * page_size, true);
+  std::set<char*> starts = FillBlocks(&arena, 3);
+  for (std::set<char*>::iterator it = starts.begin(); it != starts.end();
+       ++it) {
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(*it) % page_size);
+  }
+}
+
+TEST(ArenaTest, MmapBlocks) {
+  const UnsafeArena::BlockSource kSources[] = {
+    UnsafeArena::MMAP_BLOCKS,
+    UnsafeArena::HUGE_PAGE_BLOCKS,
+    UnsafeArena::HUGETLB_BLOCKS,
+  };
+  for (size_t i = 0; i < ARRAYSIZE(kSources); ++i) {
+    UnsafeArena arena(64 * 1024);
+    arena.set_block_source(kSources[i]);
+    EXPECT_EQ(kSources[i], arena.block_source());
+    arena.set_block_recycling(1);
+    char* first = arena.Alloc(1);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(first) % getpagesize());
+
+    // Fill a second block, and an oversize one that is unmapped on Reset().
+    int blocks = arena.block_count();
+    char* second = nullptr;
+    while (arena.block_count() == blocks)
+      second = arena.Alloc(1000);
+    memset(second, 0xab, 1000);
+    memset(arena.Alloc(1 << 20), 0xcd, 1 << 20);
+    arena.Reset();
+    EXPECT_EQ(1u, arena.free_block_count());
+
+    // The recycled block had its pages dropped, so it reads back as zeros.
+    blocks = arena.block_count();
+    char* reused = nullptr;
+    while (arena.block_count() == blocks)
+      reused = arena.Alloc(1000);
+    EXPECT_EQ(second, reused);
+    for (int j = 0; j < 1000; ++j)
+      ASSERT_EQ(0, reused[j]);
+  }
+}
+
+namespace {
+
+class Tracked {
+ public:
+  Tracked(std::vector<int>* destroyed, int id)
+    : destroyed_(destroyed), id_(id), name_(100, 'x') {}
+  ~Tracked() { destroyed_->push_back(id_); }
+
+  int id() const { return id_; }
+
+ private:
+  std::vector<int>* destroyed_;
+  int id_;
+  std::string name_;
+};
+
+struct Point {
+  int x;
+  int y;
+};
+
+struct alignas(32) Wide {
+  char bytes[32];
+};
+
+} // namespace
+
+TEST(ArenaTest, CreateRunsDestructorsInReverseOnReset) {
+  std::vector<int> destroyed;
+  UnsafeArena arena(kBlockSize);
+  for (int i = 0; i < 50; ++i) {
+    Tracked* tracked = arena.Create<Tracked>(&destroyed, i);
+    EXPECT_EQ(i, tracked->id());
+  }
+  EXPECT_EQ(50u, arena.cleanup_count());
+  arena.Reset();
+  EXPECT_EQ(0u, arena.cleanup_count());
+  ASSERT_EQ(50u, destroyed.size());
+  for (int i = 0; i < 50; ++i)
+    EXPECT_EQ(49 - i, destroyed[i]);
+
+  // Reset() does not run them twice.
+  arena.Reset();
+  EXPECT_EQ(50u, destroyed.size());
+}
+
+TEST(ArenaTest, CreateSkipsTriviallyDestructibleTypes) {
+  UnsafeArena arena(kBlockSize);
+  Point* point = arena.Create<Point>();
+  point->x = 1;
+  arena.Create<int>(5);
+  Wide* wide = arena.Create<Wide>();
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(wide) % 32);
+  EXPECT_EQ(0u, arena.cleanup_count());
+}
+
+TEST(ArenaTest, CreateRunsDestructorsOnDestruction) {
+  std::vector<int> destroyed;
+  {
+    SafeArena arena(kBlockSize);
+    arena.Create<Tracked>(&destroyed, 1);
+    arena.Create<Tracked>(&destroyed, 2);
+    EXPECT_EQ(2u, arena.cleanup_count());
+  }
+  ASSERT_EQ(2u, destroyed.size());
+  EXPECT_EQ(2, destroyed[0]);
+  EXPECT_EQ(1, destroyed[1]);
+}
+
+TEST(ArenaTest, StatusAccountsForRequestsAndWaste) {
+  UnsafeArena arena(kBlockSize);
+  arena.Alloc(1);
+  arena.AllocAligned(8, 8);
+  BaseArena::Status status = arena.status();
+  EXPECT_EQ(9u, status.bytes_requested());
+  // The arena starts kDefaultAlignment-aligned, so the 1-byte allocation
+  // leaves 3 or 7 bytes of padding before the 8-aligned one.
+  EXPECT_GE(status.bytes_wasted(), 3u);
+  EXPECT_LE(status.bytes_wasted(), 7u);
+
+  arena.Alloc(kBlockSize);
+  status = arena.status();
+  EXPECT_EQ(1u, status.oversize_blocks());
+  EXPECT_EQ(kBlockSize, status.oversize_bytes());
+  EXPECT_EQ(2 * kBlockSize, status.bytes_allocated());
+
+  // Starting a new block abandons the tail of the current one.
+  size_t wasted = status.bytes_wasted();
+  size_t tail = arena.bytes_until_next_allocation();
+  arena.Alloc(kBlockSize / 4);
+  arena.Alloc(kBlockSize / 4);
+  arena.Alloc(kBlockSize / 4);
+  arena.Alloc(kBlockSize / 4);
+  EXPECT_EQ(wasted + tail - 3 * (kBlockSize / 4), arena.status().bytes_wasted());
+}
+
+TEST(ArenaTest, StatusKeepsPeaksAndResetHistogram) {
+  UnsafeArena arena(kBlockSize);
+  EXPECT_EQ(0u, arena.status().reset_count());
+  arena.Alloc(kBlockSize * 4);
+  arena.Reset();
+  arena.Alloc(100);
+  arena.Reset();
+  arena.Reset();
+
+  BaseArena::Status status = arena.status();
+  EXPECT_EQ(3u, status.reset_count());
+  EXPECT_EQ(0u, status.bytes_requested());
+  EXPECT_EQ(kBlockSize, status.bytes_allocated());
+  EXPECT_EQ(5 * kBlockSize, status.peak_bytes_allocated());
+  EXPECT_EQ(4 * kBlockSize, status.peak_bytes_requested());
+  EXPECT_EQ(1u, status.reset_histogram(0));
+  EXPECT_EQ(1u, status.reset_histogram(7));   // 100 bytes
+  EXPECT_EQ(1u, status.reset_histogram(13));  // 4096 bytes
+}
+
+TEST(ArenaTest, LiveArenaRegistry) {
+  std::vector<BaseArena::LiveArena> before;
+  BaseArena::GetLiveArenas(&before);
+  {
+    UnsafeArena arena(kBlockSize);
+    arena.set_name("registry_test");
+    arena.Alloc(10);
+    std::vector<BaseArena::LiveArena> live;
+    BaseArena::GetLiveArenas(&live);
+    ASSERT_EQ(before.size() + 1, live.size());
+    bool found = false;
+    for (size_t i = 0; i < live.size(); ++i) {
+      if (std::string("registry_test") == live[i].name) {
+        found = true;
+        EXPECT_EQ(kBlockSize, live[i].block_size);
+        EXPECT_EQ(10u, live[i].status.bytes_requested());
+      }
+    }
+    EXPECT_TRUE(found);
+  }
+  std::vector<BaseArena::LiveArena> after;
+  BaseArena::GetLiveArenas(&after);
+  EXPECT_EQ(before.size(), after.size());
+}
+
+TEST(ArenaTest, LiveArenaRegistryLocksSafeArenas) {
+  const int kAllocs = 100000;
+  SafeArena arena(kBlockSize);
+  arena.set_name("registry_safe_test");
+  AllocThread thread(&arena, kAllocs);
+  thread.Start();
+  size_t last = 0;
+  for (int i = 0; i < 100; ++i) {
+    std::vector<BaseArena::LiveArena> live;
+    BaseArena::GetLiveArenas(&live);
+    for (size_t j = 0; j < live.size(); ++j) {
+      if (std::string("registry_safe_test") != live[j].name)
+        continue;
+      // Snapshots are taken between allocations, never in the middle of one.
+      size_t requested = live[j].status.bytes_requested();
+      EXPECT_EQ(0u, requested % 16);
+      EXPECT_GE(requested, last);
+      last = requested;
+    }
+  }
+  thread.Join();
+  EXPECT_EQ(16u * kAllocs, arena.status().bytes_requested());
+}
+
+TEST(ArenaTest, UnnamedArenasAreNotListed) {
+  std::vector<BaseArena::LiveArena> before;
+  BaseArena::GetLiveArenas(&before);
+  UnsafeArena unsafe_arena(kBlockSize);
+  SafeArena safe_arena(kBlockSize);
+  std::vector<BaseArena::LiveArena> live;
+  BaseArena::GetLiveArenas(&live);
+  EXPECT_EQ(before.size(), live.size());
+
+  // Naming twice relabels the arena without listing it again.
+  unsafe_arena.set_name("registry_first");
+  unsafe_arena.set_name("registry_second");
+  BaseArena::GetLiveArenas(&live);
+  ASSERT_EQ(before.size() + 1, live.size());
+  EXPECT_EQ(std::string("registry_second"), live[0].name);
+}
+
+TEST(ArenaTest, LiveArenaRegistryReadsBusyUnsafeArenas) {
+  const int kAllocs = 100000;
+  UnsafeArena arena(kBlockSize);
+  arena.set_name("registry_unsafe_test");
+  AllocThread thread(&arena, kAllocs);
+  thread.Start();
+  size_t last = 0;
+  for (int i = 0; i < 100; ++i) {
+    std::vector<BaseArena::LiveArena> live;
+    BaseArena::GetLiveArenas(&live);
+    for (size_t j = 0; j < live.size(); ++j) {
+      if (std::string("registry_unsafe_test") != live[j].name)
+        continue;
+      size_t requested = live[j].status.bytes_requested();
+      EXPECT_EQ(0u, requested % 16);
+      EXPECT_GE(requested, last);
+      EXPECT_GE(live[j].block_count, 1);
+      last = requested;
+    }
+  }
+  thread.Join();
+  EXPECT_EQ(16u * kAllocs, arena.status().bytes_requested());
+}
@@ -0,0 +1,113 @@
+#include "base/chained_pickle.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <limits>
+
+#include "base/bits.h"
+
+namespace mrpc {
+
+// static
+const size_t ChainedPickle::kDefaultSegmentSize = 64 * 1024;
+
+PickleIterator::PickleIterator(const ChainedPickle& pickle)
+    : pickle_(NULL),
+      payload_(static_cast<const char*>(pickle.segments()[0].iov_base) +
+               sizeof(Pickle::Header)),
+      read_index_(0),
+      end_index_(pickle.segments()[0].iov_len - sizeof(Pickle::Header)),
+      alignment_(sizeof(uint32_t)),
+      payload_offset_(sizeof(Pickle::Header)),
+      next_segment_(pickle.segments() + 1),
+      end_segment_(pickle.segments() + pickle.segment_count()) {
+}
+
+ChainedPickle::ChainedPickle()
+    : header_(NULL),
+      segment_size_(kDefaultSegmentSize),
+      remaining_(0) {
+  NewSegment(sizeof(Pickle::Header));
+  header_ = static_cast<Pickle::Header*>(ClaimUninitializedBytes(
+      sizeof(Pickle::Header)));
+  header_->payload_size = 0;
+}
+
+ChainedPickle::ChainedPickle(size_t segment_size)
+    : header_(NULL),
+      segment_size_(segment_size),
+      remaining_(0) {
+  DCHECK_EQ(segment_size_, bits::Align(segment_size_, sizeof(uint32_t)));
+  DCHECK_GE(segment_size_, sizeof(Pickle::Header));
+  NewSegment(sizeof(Pickle::Header));
+  header_ = static_cast<Pickle::Header*>(ClaimUninitializedBytes(
+      sizeof(Pickle::Header)));
+  header_->payload_size = 0;
+}
+
+ChainedPickle::~ChainedPickle() {
+  for (size_t i = 0; i < segments_.size(); ++i)
+    free(segments_[i].iov_base);
+}
+
+bool ChainedPickle::WriteString(const StringPiece& value) {
+  if (!WriteInt(static_cast<int>(value.size())))
+    return false;
+
+  return WriteBytes(value.data(), static_cast<int>(value.size()));
+}
+
+bool ChainedPickle::WriteData(const char* data, int length) {
+  return length >= 0 && WriteInt(length) && WriteBytes(data, length);
+}
+
+bool ChainedPickle::WriteBytes(const void* data, int length) {
+  WriteBytesCommon(data, length);
+  return true;
+}
+
+void ChainedPickle::Flatten(std::string* output) const {
+  output->clear();
+  output->reserve(size());
+  for (size_t i = 0; i < segments_.size(); ++i) {
+    output->append(static_cast<const char*>(segments_[i].iov_base),
+                   segments_[i].iov_len);
+  }
+}
+
+void ChainedPickle::NewSegment(size_t min_capacity) {
+  size_t capacity = std::max(segment_size_, min_capacity);
+  struct iovec segment;
+  segment.iov_base = malloc(capacity);
+  CHECK(segment.iov_base);
+  segment.iov_len = 0;
+  segments_.push_back(segment);
+  remaining_ = capacity;
+}
+
+void* ChainedPickle::ClaimUninitializedBytes(size_t length) {
+  size_t data_len = bits::Align(length, sizeof(uint32_t));
+  DCHECK_GE(data_len, length);
+  DCHECK_LE(data_len, std::numeric_limits<uint32_t>::max());
+  if (data_len > remaining_)
+    NewSegment(data_len);
+
+  struct iovec& segment = segments_.back();
+  char* write = static_cast<char*>(segment.iov_base) + segment.iov_len;
+  memset(write + length, 0, data_len - length);  // Always initialize padding
+  segment.iov_len += data_len;
+  remaining_ -= data_len;
+  return write;
+}
+
+void ChainedPickle::WriteBytesCommon(const void* data, size_t length) {
+  size_t data_len = bits::Align(length, sizeof(uint32_t));
+  DCHECK_LE(header_->payload_size,
+            std::numeric_limits<uint32_t>::max() - data_len);
+  void* write = ClaimUninitializedBytes(length);
+  memcpy(write, data, length);
+  header_->payload_size += static_cast<uint32_t>(data_len);
+}
+
+} // namespace mrpc
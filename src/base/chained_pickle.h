@@ -0,0 +1,96 @@
+#ifndef MRPC_BASE_CHAINED_PICKLE_H_
+#define MRPC_BASE_CHAINED_PICKLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/pickle.h"
+#include "base/string_piece.h"
+
+namespace mrpc {
+
+// ChainedPickle writes the same wire format as Pickle, but into a chain of
+// fixed-size segments instead of one buffer that is realloc'd as it grows.
+// Nothing is ever copied once written, and the segments are exposed as an
+// iovec array so that a transport can writev() them directly:
+//
+//   ChainedPickle pickle;
+//   pickle.WriteInt(42);
+//   pickle.WriteString(large_value);
+//   writev(fd, pickle.segments(), pickle.segment_count());
+//
+// A field is never split across two segments; a field larger than the
+// segment size gets a segment of its own. The concatenation of all segments
+// is byte-for-byte what Pickle would have produced, so the receiver can read
+// it with a plain Pickle, and PickleIterator can read the chain in place.
+class ChainedPickle {
+ public:
+  static const size_t kDefaultSegmentSize;
+
+  ChainedPickle();
+  // |segment_size| must be a multiple of four that can hold the header.
+  explicit ChainedPickle(size_t segment_size);
+  ~ChainedPickle();
+
+  // Total number of bytes in the chain, header included.
+  size_t size() const { return sizeof(Pickle::Header) + payload_size(); }
+  size_t payload_size() const { return header_->payload_size; }
+  size_t segment_size() const { return segment_size_; }
+
+  // The first segment starts with the Pickle header. Only the used part of
+  // each segment is covered by its iov_len.
+  const struct iovec* segments() const { return &segments_[0]; }
+  int segment_count() const { return static_cast<int>(segments_.size()); }
+
+  bool WriteBool(bool value) {
+    return WriteInt(value ? 1 : 0);
+  }
+  bool WriteInt(int value) { return WritePOD(value); }
+  bool WriteLong(long value) {
+    // Always write long as a 64-bit value, as Pickle does.
+    return WritePOD(static_cast<int64_t>(value));
+  }
+  bool WriteUInt16(uint16_t value) { return WritePOD(value); }
+  bool WriteUInt32(uint32_t value) { return WritePOD(value); }
+  bool WriteInt64(int64_t value) { return WritePOD(value); }
+  bool WriteUInt64(uint64_t value) { return WritePOD(value); }
+  bool WriteFloat(float value) { return WritePOD(value); }
+  bool WriteDouble(double value) { return WritePOD(value); }
+  bool WriteString(const StringPiece& value);
+  bool WriteData(const char* data, int length);
+  bool WriteBytes(const void* data, int length);
+
+  // Copies the chain into |output| as one contiguous buffer, for transports
+  // that cannot take an iovec array.
+  void Flatten(std::string* output) const;
+
+ private:
+  // Starts a new segment that can hold at least |min_capacity| bytes.
+  void NewSegment(size_t min_capacity);
+
+  // Claims |length| bytes plus padding, starting a new segment if the field
+  // does not fit in the current one. Padding is zeroed.
+  void* ClaimUninitializedBytes(size_t length);
+  void WriteBytesCommon(const void* data, size_t length);
+
+  template <typename T> bool WritePOD(const T& data) {
+    WriteBytesCommon(&data, sizeof(data));
+    return true;
+  }
+
+  Pickle::Header* header_;
+  std::vector<struct iovec> segments_;
+  const size_t segment_size_;
+  // Bytes left after the used part of the last segment.
+  size_t remaining_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChainedPickle);
+};
+
+} // namespace mrpc
+#endif // MRPC_BASE_CHAINED_PICKLE_H_
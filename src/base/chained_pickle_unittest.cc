@@ -0,0 +1,115 @@
+#include "base/chained_pickle.h"
+#include <gtest/gtest.h>
+
+#include <string>
+
+using namespace mrpc;
+
+namespace {
+
+const int testint = 2093847192;
+const int64_t testint64 = -0x7E8CA9253104BDFCLL;
+const double testdouble = 2.71828182845904523;
+const std::string teststring("Hello world");  // note non-aligned string length
+
+void WriteFields(ChainedPickle* chained, Pickle* pickle) {
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(chained->WriteInt(testint + i));
+    EXPECT_TRUE(chained->WriteInt64(testint64));
+    EXPECT_TRUE(chained->WriteString(teststring));
+    EXPECT_TRUE(chained->WriteDouble(testdouble));
+    pickle->WriteInt(testint + i);
+    pickle->WriteInt64(testint64);
+    pickle->WriteString(teststring);
+    pickle->WriteDouble(testdouble);
+  }
+}
+
+void VerifyFields(PickleIterator* iter) {
+  for (int i = 0; i < 100; ++i) {
+    int outint;
+    EXPECT_TRUE(iter->ReadInt(&outint));
+    EXPECT_EQ(testint + i, outint);
+
+    int64_t outint64;
+    EXPECT_TRUE(iter->ReadInt64(&outint64));
+    EXPECT_EQ(testint64, outint64);
+
+    std::string outstring;
+    EXPECT_TRUE(iter->ReadString(&outstring));
+    EXPECT_EQ(teststring, outstring);
+
+    double outdouble;
+    EXPECT_TRUE(iter->ReadDouble(&outdouble));
+    EXPECT_EQ(testdouble, outdouble);
+  }
+  int outint;
+  EXPECT_FALSE(iter->ReadInt(&outint));
+}
+
+} // namespace
+
+TEST(ChainedPickleTest, SameWireFormatAsPickle) {
+  ChainedPickle chained(64);
+  Pickle pickle;
+  WriteFields(&chained, &pickle);
+
+  EXPECT_GT(chained.segment_count(), 1);
+  EXPECT_EQ(pickle.size(), chained.size());
+
+  std::string flat;
+  chained.Flatten(&flat);
+  ASSERT_EQ(pickle.size(), flat.size());
+  EXPECT_EQ(0, memcmp(pickle.data(), flat.data(), flat.size()));
+
+  Pickle view(flat.data(), static_cast<int>(flat.size()));
+  PickleIterator iter(view);
+  VerifyFields(&iter);
+}
+
+TEST(ChainedPickleTest, ReadAcrossSegments) {
+  ChainedPickle chained(64);
+  Pickle pickle;
+  WriteFields(&chained, &pickle);
+
+  size_t total = 0;
+  for (int i = 0; i < chained.segment_count(); ++i) {
+    EXPECT_LE(chained.segments()[i].iov_len, chained.segment_size());
+    total += chained.segments()[i].iov_len;
+  }
+  EXPECT_EQ(chained.size(), total);
+
+  PickleIterator iter(chained);
+  VerifyFields(&iter);
+}
+
+TEST(ChainedPickleTest, OversizedField) {
+  ChainedPickle chained(64);
+  std::string big(1000, 'x');
+  EXPECT_TRUE(chained.WriteInt(1));
+  EXPECT_TRUE(chained.WriteData(big.data(), static_cast<int>(big.size())));
+  EXPECT_TRUE(chained.WriteInt(2));
+
+  PickleIterator iter(chained);
+  int outint;
+  EXPECT_TRUE(iter.ReadInt(&outint));
+  EXPECT_EQ(1, outint);
+  const char* data;
+  int length;
+  EXPECT_TRUE(iter.ReadData(&data, &length));
+  EXPECT_EQ(big, std::string(data, length));
+  EXPECT_TRUE(iter.ReadInt(&outint));
+  EXPECT_EQ(2, outint);
+  EXPECT_FALSE(iter.ReadInt(&outint));
+}
+
+TEST(ChainedPickleTest, EmptyPickle) {
+  ChainedPickle chained;
+  EXPECT_EQ(1, chained.segment_count());
+  EXPECT_EQ(0u, chained.payload_size());
+  EXPECT_EQ(sizeof(Pickle::Header), chained.segments()[0].iov_len);
+
+  PickleIterator iter(chained);
+  int outint;
+  EXPECT_FALSE(iter.ReadInt(&outint));
+}
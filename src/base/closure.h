@@ -0,0 +1,13 @@
+#ifndef MRPC_BASE_CLOSURE_H_
+#define MRPC_BASE_CLOSURE_H_
+
+#include <functional>
+
+namespace mrpc {
+
+// A unit of work handed to another thread or run later, such as a task
+// posted to an EventLoop.
+typedef std::function<void()> Closure;
+
+} // namespace mrpc
+#endif // MRPC_BASE_CLOSURE_H_
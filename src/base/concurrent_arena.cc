@@ -0,0 +1,106 @@
+#include "base/concurrent_arena.h"
+
+#include <stddef.h>
+
+namespace mrpc {
+
+// A thread's current block in one arena. The block is valid while |arena_id|
+// and |generation| match the arena; ids are never reused, so a cache entry
+// cannot outlive its arena by mistake.
+struct ConcurrentArena::ThreadBlock {
+  uint32_t arena_id;
+  Atomic32 generation;
+  char* freestart;
+  size_t remaining;
+};
+
+namespace {
+
+volatile Atomic32 next_arena_id = 0;
+
+} // namespace
+
+thread_local ConcurrentArena::ThreadBlock
+    ConcurrentArena::thread_blocks_[kThreadBlockCacheSize];
+thread_local int ConcurrentArena::next_thread_block_ = 0;
+
+ConcurrentArena::ConcurrentArena(size_t block_size, size_t thread_block_size)
+  : shared_(block_size),
+    thread_block_size_(thread_block_size),
+    id_(static_cast<uint32_t>(Barrier_AtomicIncrement(&next_arena_id, 1))),
+    generation_(0) {
+  CHECK_GE(thread_block_size_, static_cast<size_t>(kThreadBlockAlignment));
+  // Thread blocks must come out of the shared arena's own blocks.
+  CHECK_LE(thread_block_size_, block_size / 4);
+}
+
+ConcurrentArena::~ConcurrentArena() {
+}
+
+ConcurrentArena::ThreadBlock* ConcurrentArena::GetThreadBlock() {
+  Atomic32 generation = Acquire_Load(&generation_);
+  for (int i = 0; i < kThreadBlockCacheSize; ++i) {
+    ThreadBlock* block = &thread_blocks_[i];
+    if (block->arena_id == id_ && block->generation == generation)
+      return block;
+  }
+  ThreadBlock* block = &thread_blocks_[next_thread_block_];
+  next_thread_block_ = (next_thread_block_ + 1) % kThreadBlockCacheSize;
+  block->arena_id = id_;
+  block->generation = generation;
+  block->freestart = nullptr;
+  block->remaining = 0;
+  return block;
+}
+
+void* ConcurrentArena::AllocAligned(const size_t size, const int align_as_int) {
+  if (size == 0)
+    return nullptr;
+  const size_t align = static_cast<size_t>(align_as_int);
+  DCHECK(align > 0 && (align & (align - 1)) == 0);
+  ThreadBlock* block = GetThreadBlock();
+  const size_t overage =
+      reinterpret_cast<uintptr_t>(block->freestart) & (align - 1);
+  const size_t waste = overage ? align - overage : 0;
+  if (size + waste <= block->remaining) {
+    char* result = block->freestart + waste;
+    block->freestart = result + size;
+    block->remaining -= size + waste;
+    return result;
+  }
+  return AllocSlow(block, size, align);
+}
+
+void* ConcurrentArena::AllocSlow(ThreadBlock* block, size_t size,
+                                 size_t align) {
+  if (size > thread_block_size_ / 4 || align > kThreadBlockAlignment) {
+    // Too big to share a thread block, or aligned more strictly than the
+    // thread blocks are: leave the current block alone.
+    if (size > shared_.block_size() / 4) {
+      // BaseArena mallocs these on their own, which aligns them for any
+      // fundamental type and no more.
+      CHECK_LE(align, alignof(max_align_t));
+    }
+    return shared_.AllocAligned(size, static_cast<int>(align));
+  }
+  block->freestart = reinterpret_cast<char*>(
+      shared_.AllocAligned(thread_block_size_, kThreadBlockAlignment));
+  block->remaining = thread_block_size_;
+  // Thread blocks start aligned for any |align| we accept here.
+  char* result = block->freestart;
+  block->freestart += size;
+  block->remaining -= size;
+  return result;
+}
+
+void ConcurrentArena::Free(void* memory, size_t size) {
+  if (size > thread_block_size_ / 4)
+    shared_.Free(memory, size);
+}
+
+void ConcurrentArena::Reset() {
+  Barrier_AtomicIncrement(&generation_, 1);
+  shared_.Reset();
+}
+
+} // namespace mrpc
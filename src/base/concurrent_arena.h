@@ -0,0 +1,72 @@
+#ifndef MRPC_BASE_CONCURRENT_ARENA_H_
+#define MRPC_BASE_CONCURRENT_ARENA_H_
+
+#include <stdint.h>
+
+#include "base/arena.h"
+#include "base/atomicops.h"
+#include "base/macros.h"
+
+namespace mrpc {
+
+// An arena that many threads can allocate from without serializing on a
+// lock. Each thread bump-allocates from its own block, which it carves out
+// of a shared SafeArena; only refilling that block takes the SafeArena lock.
+//
+// As with the other arenas, memory is only reclaimed by Reset(), which must
+// not race with allocations. Reset() returns every thread's block at once:
+// it bumps a generation number that invalidates all thread caches, and
+// resets the shared arena they were carved from.
+class ConcurrentArena {
+ public:
+  // Each thread takes |thread_block_size| bytes at a time from a shared
+  // arena of |block_size| blocks; |thread_block_size| may be at most a
+  // quarter of |block_size|. Requests over a quarter of a thread block go
+  // straight to the shared arena.
+  explicit ConcurrentArena(size_t block_size,
+                           size_t thread_block_size = kDefaultThreadBlockSize);
+  ~ConcurrentArena();
+
+  char* Alloc(const size_t size) {
+    return reinterpret_cast<char*>(AllocAligned(size, 1));
+  }
+  void* AllocAligned(const size_t size, const int align);
+
+  // Only an oversize allocation can be handed back to the shared arena, and
+  // only when it was the last thing that arena gave out, so this mostly
+  // does nothing.
+  void Free(void* memory, size_t size);
+
+  void Reset();
+
+  // Capacity taken from the system, as BaseArena::Status reports it.
+  BaseArena::Status status() { return shared_.status(); }
+  size_t thread_block_size() const { return thread_block_size_; }
+
+  static const size_t kDefaultThreadBlockSize = 4096;
+
+ private:
+  struct ThreadBlock;
+
+  // Thread blocks are aligned for any fundamental type.
+  static const size_t kThreadBlockAlignment = 16;
+  // Blocks for the few arenas a thread used last. A thread that allocates
+  // from more arenas than this abandons the tail of the least recently
+  // refilled block.
+  static const int kThreadBlockCacheSize = 4;
+  static thread_local ThreadBlock thread_blocks_[kThreadBlockCacheSize];
+  static thread_local int next_thread_block_;
+
+  ThreadBlock* GetThreadBlock();
+  void* AllocSlow(ThreadBlock* block, size_t size, size_t align);
+
+  SafeArena shared_;
+  const size_t thread_block_size_;
+  const uint32_t id_;
+  volatile Atomic32 generation_;
+
+  DISALLOW_COPY_AND_ASSIGN(ConcurrentArena);
+};
+
+} // namespace mrpc
+#endif // MRPC_BASE_CONCURRENT_ARENA_H_
@@ -0,0 +1,117 @@
+#include "base/concurrent_arena.h"
+#include <gtest/gtest.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "base/thread.h"
+
+using namespace mrpc;
+
+namespace {
+
+const size_t kBlockSize = 64 * 1024;
+
+class AllocThread : public Thread {
+ public:
+  AllocThread(ConcurrentArena* arena, uint8_t tag, int count)
+    : Thread(Options("arena_alloc")), arena_(arena), tag_(tag),
+      count_(count) {}
+
+  virtual void Run() override {
+    for (int i = 0; i < count_; ++i) {
+      size_t size = 1 + (i * 7) % 200;
+      char* memory = arena_->Alloc(size);
+      memset(memory, tag_, size);
+      allocations_.push_back(std::make_pair(memory, size));
+    }
+  }
+
+  // True if nobody else wrote into this thread's allocations.
+  bool Verify() const {
+    for (size_t i = 0; i < allocations_.size(); ++i) {
+      for (size_t j = 0; j < allocations_[i].second; ++j) {
+        if (static_cast<uint8_t>(allocations_[i].first[j]) != tag_)
+          return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  ConcurrentArena* arena_;
+  uint8_t tag_;
+  int count_;
+  std::vector<std::pair<char*, size_t> > allocations_;
+};
+
+} // namespace
+
+TEST(ConcurrentArenaTest, ThreadsGetDisjointMemory) {
+  ConcurrentArena arena(kBlockSize);
+  std::vector<AllocThread*> threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.push_back(new AllocThread(&arena, static_cast<uint8_t>(i + 1),
+                                      20000));
+    threads.back()->Start();
+  }
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i]->Join();
+  for (size_t i = 0; i < threads.size(); ++i) {
+    EXPECT_TRUE(threads[i]->Verify()) << "thread " << i;
+    delete threads[i];
+  }
+}
+
+TEST(ConcurrentArenaTest, HonorsAlignment) {
+  ConcurrentArena arena(kBlockSize);
+  arena.Alloc(3);
+  for (int align = 1; align <= 64; align *= 2) {
+    void* memory = arena.AllocAligned(24, align);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(memory) % align);
+  }
+  // Oversize allocations bypass the thread block.
+  char* before = arena.Alloc(1);
+  void* big = arena.AllocAligned(arena.thread_block_size(), 8);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(big) % 8);
+  char* after = arena.Alloc(1);
+  EXPECT_EQ(before + 1, after);
+}
+
+TEST(ConcurrentArenaTest, OversizeAllocationsKeepTheirAlignment) {
+  ConcurrentArena arena(kBlockSize);
+  // Too big for the shared arena's blocks, so they get blocks of their own.
+  for (size_t align = 1; align <= alignof(max_align_t); align *= 2) {
+    void* memory = arena.AllocAligned(kBlockSize, static_cast<int>(align));
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(memory) % align);
+  }
+}
+
+TEST(ConcurrentArenaTest, ResetReclaimsThreadBlocks) {
+  ConcurrentArena arena(kBlockSize, 1024);
+  size_t empty = arena.status().bytes_allocated();
+  for (int i = 0; i < 10000; ++i)
+    arena.Alloc(100);
+  EXPECT_GT(arena.status().bytes_allocated(), empty);
+
+  arena.Reset();
+  EXPECT_EQ(empty, arena.status().bytes_allocated());
+  // The thread block from before Reset() is not reused.
+  char* first = arena.Alloc(16);
+  memset(first, 0, 16);
+  char* second = arena.Alloc(16);
+  EXPECT_EQ(first + 16, second);
+}
+
+TEST(ConcurrentArenaTest, ThreadsUseSeveralArenas) {
+  ConcurrentArena a(kBlockSize);
+  ConcurrentArena b(kBlockSize);
+  char* a1 = a.Alloc(8);
+  char* b1 = b.Alloc(8);
+  char* a2 = a.Alloc(8);
+  char* b2 = b.Alloc(8);
+  EXPECT_EQ(a1 + 8, a2);
+  EXPECT_EQ(b1 + 8, b2);
+}
@@ -0,0 +1,61 @@
+#include "base/futex_mutex.h"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace mrpc {
+
+namespace {
+
+void FutexWait(volatile Atomic32* address, Atomic32 expected) {
+  syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, expected, nullptr,
+          nullptr, 0);
+}
+
+void FutexWake(volatile Atomic32* address, int count) {
+  syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+inline void PauseCpu() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#endif
+}
+
+} // namespace
+
+const int FutexMutex::kMaxSpins;
+
+void FutexMutex::LockSlow() {
+  Atomic32 estimate = NoBarrier_Load(&spin_estimate_);
+  const int max_spins = std::min(kMaxSpins, 2 * estimate + 10);
+  for (int spins = 0; spins < max_spins; ++spins) {
+    if (NoBarrier_Load(&state_) == kUnlocked &&
+        Acquire_CompareAndSwap(&state_, kUnlocked, kLocked) == kUnlocked) {
+      NoBarrier_Store(&spin_estimate_, estimate + (spins - estimate) / 8);
+      return;
+    }
+    PauseCpu();
+  }
+  NoBarrier_Store(&spin_estimate_, estimate + (max_spins - estimate) / 8);
+
+  // Marking the lock contended before sleeping makes the holder's Unlock()
+  // wake us. Taking it as kContended may cause one needless wake-up later,
+  // which is the price of not knowing whether other sleepers remain.
+  while (NoBarrier_AtomicExchange(&state_, kContended) != kUnlocked)
+    FutexWait(&state_, kContended);
+  // The exchange above has no barrier of its own.
+  MemoryBarrier();
+}
+
+void FutexMutex::UnlockSlow() {
+  Release_Store(&state_, kUnlocked);
+  FutexWake(&state_, 1);
+}
+
+} // namespace mrpc
@@ -0,0 +1,63 @@
+#ifndef MRPC_BASE_FUTEX_MUTEX_H_
+#define MRPC_BASE_FUTEX_MUTEX_H_
+
+#include "base/atomicops.h"
+#include "base/lazy_instance.h"
+#include "base/macros.h"
+
+namespace mrpc {
+
+// A mutex for short, hot critical sections, built on a Linux futex.
+//
+// Unlike Mutex it never enters the kernel when uncontended, and under
+// contention it spins for a while before it parks, since the holder of a
+// short critical section is likely to release it soon. The spin is bounded
+// by kMaxSpins and adapts to how long recent acquisitions took to succeed.
+// Use it with LockGuard<FutexMutex>. It does not work with
+// ConditionVariable; use Mutex where one is needed.
+class FutexMutex final {
+ public:
+  FutexMutex() : state_(kUnlocked), spin_estimate_(0) {}
+  ~FutexMutex() { DCHECK_EQ(kUnlocked, NoBarrier_Load(&state_)); }
+
+  void Lock() {
+    if (Acquire_CompareAndSwap(&state_, kUnlocked, kLocked) != kUnlocked)
+      LockSlow();
+  }
+  void Unlock() {
+    // kLocked drops to kUnlocked; anything else had sleepers.
+    if (Barrier_AtomicIncrement(&state_, -1) != kUnlocked)
+      UnlockSlow();
+  }
+  bool TryLock() {
+    return Acquire_CompareAndSwap(&state_, kUnlocked, kLocked) == kUnlocked;
+  }
+
+  static const int kMaxSpins = 100;
+
+ private:
+  enum State {
+    kUnlocked = 0,
+    kLocked = 1,
+    // Locked, and a thread may be asleep in FUTEX_WAIT.
+    kContended = 2,
+  };
+
+  void LockSlow();
+  void UnlockSlow();
+
+  volatile Atomic32 state_;
+  // A running average of the spins recent contended Lock()s needed. Updated
+  // racily; it only steers the spin limit.
+  volatile Atomic32 spin_estimate_;
+
+  DISALLOW_COPY_AND_ASSIGN(FutexMutex);
+};
+
+typedef LazyStaticInstance<FutexMutex,
+                           DefaultConstructTrait<FutexMutex>,
+                           ThreadSafeInitOnceTrait>::type LazyFutexMutex;
+#define LAZY_FUTEX_MUTEX_INITIALIZER LAZY_STATIC_INSTANCE_INITIALIZER
+
+} // namespace mrpc
+#endif // MRPC_BASE_FUTEX_MUTEX_H_
@@ -0,0 +1,87 @@
+#include "base/futex_mutex.h"
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "base/mutex.h"
+#include "base/thread.h"
+
+using namespace mrpc;
+
+namespace {
+
+class CounterThread : public Thread {
+ public:
+  CounterThread(FutexMutex* mutex, int64_t* counter, int iterations)
+    : Thread(Options("counter")),
+      mutex_(mutex),
+      counter_(counter),
+      iterations_(iterations) {}
+
+  virtual void Run() override {
+    for (int i = 0; i < iterations_; ++i) {
+      LockGuard<FutexMutex> lock_guard(mutex_);
+      ++*counter_;
+    }
+  }
+
+ private:
+  FutexMutex* mutex_;
+  int64_t* counter_;
+  int iterations_;
+};
+
+LazyFutexMutex lazy_mutex = LAZY_FUTEX_MUTEX_INITIALIZER;
+
+} // namespace
+
+TEST(FutexMutexTest, LockUnlockTryLock) {
+  FutexMutex mutex;
+  EXPECT_TRUE(mutex.TryLock());
+  EXPECT_FALSE(mutex.TryLock());
+  mutex.Unlock();
+  {
+    LockGuard<FutexMutex> lock_guard(&mutex);
+    EXPECT_FALSE(mutex.TryLock());
+  }
+  EXPECT_TRUE(mutex.TryLock());
+  mutex.Unlock();
+}
+
+TEST(FutexMutexTest, LazyInstance) {
+  LockGuard<FutexMutex> lock_guard(lazy_mutex.Pointer());
+  EXPECT_FALSE(lazy_mutex.Pointer()->TryLock());
+}
+
+TEST(FutexMutexTest, ExcludesUnderContention) {
+  const int kThreads = 8;
+  const int kIterations = 100000;
+  FutexMutex mutex;
+  int64_t counter = 0;
+  std::vector<CounterThread*> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.push_back(new CounterThread(&mutex, &counter, kIterations));
+    threads.back()->Start();
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i]->Join();
+    delete threads[i];
+  }
+  EXPECT_EQ(static_cast<int64_t>(kThreads) * kIterations, counter);
+  EXPECT_TRUE(mutex.TryLock());
+  mutex.Unlock();
+}
+
+TEST(FutexMutexTest, WakesASleepingWaiter) {
+  FutexMutex mutex;
+  int64_t counter = 0;
+  mutex.Lock();
+  CounterThread thread(&mutex, &counter, 1);
+  thread.Start();
+  // Long enough for the waiter to give up spinning and park.
+  Thread::Sleep(TimeDelta::FromMilliseconds(20));
+  EXPECT_EQ(0, counter);
+  mutex.Unlock();
+  thread.Join();
+  EXPECT_EQ(1, counter);
+}
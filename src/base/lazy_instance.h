@@ -25,13 +25,13 @@ struct StaticallyAllocatedInstanceTrait {
   };
   static_assert(ALIGNOF(StorageType) >= ALIGNOF(T), "must be same size");
 
-  static T* MutableInstace(StorageType* storage) {
+  static T* MutableInstance(StorageType* storage) {
     return reinterpret_cast<T*>(storage);
   }
 
   template <typename ConstructTrait>
   static void InitStorageUsingTrait(StorageType* storage) {
-    ConstructTrait::Construct(MutableInstace(storage));
+    ConstructTrait::Construct(MutableInstance(storage));
   }
 };
 
@@ -0,0 +1,181 @@
+#ifndef MRPC_BASE_MPMC_QUEUE_H_
+#define MRPC_BASE_MPMC_QUEUE_H_
+
+#include <stddef.h>
+
+#include <utility>
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/macros.h"
+#include "base/waiters.h"
+
+namespace mrpc {
+
+// A bounded multi-producer multi-consumer queue (Dmitry Vyukov's "Bounded
+// MPMC queue").
+//
+// Each slot carries a sequence number that says whose turn it is: a
+// producer may fill slot |pos & mask| when its sequence is |pos|, and a
+// consumer may empty it when it is |pos + 1|. Producers and consumers each
+// claim a position with one compare-and-swap on |tail_| or |head_|, which
+// sit on separate cache lines, and otherwise only touch their own slot.
+//
+// T must be default constructible and movable. TryPush() and TryPop() never
+// block; see BlockingMpmcQueue for a queue that waits.
+template <typename T>
+class MpmcQueue {
+ public:
+  // |capacity| must be a power of two, and at least 2.
+  explicit MpmcQueue(size_t capacity)
+    : slots_(capacity), mask_(capacity - 1), head_(0), tail_(0) {
+    DCHECK_GE(capacity, 2u);
+    DCHECK_EQ(0u, capacity & (capacity - 1));
+    for (size_t i = 0; i < capacity; ++i)
+      NoBarrier_Store(&slots_[i].sequence, static_cast<AtomicWord>(i));
+  }
+
+  // Returns false, leaving |item| alone, when the queue is full.
+  bool TryPush(T&& item) {
+    Slot* slot;
+    AtomicWord pos = NoBarrier_Load(&tail_.value);
+    for (;;) {
+      slot = &slots_[pos & mask_];
+      AtomicWord diff = Acquire_Load(&slot->sequence) - pos;
+      if (diff == 0) {
+        AtomicWord claimed =
+            NoBarrier_CompareAndSwap(&tail_.value, pos, pos + 1);
+        if (claimed == pos)
+          break;
+        pos = claimed;
+      } else if (diff < 0) {
+        // The slot still holds the item from a lap ago.
+        return false;
+      } else {
+        pos = NoBarrier_Load(&tail_.value);
+      }
+    }
+    slot->value = std::move(item);
+    Release_Store(&slot->sequence, pos + 1);
+    return true;
+  }
+  bool TryPush(const T& item) {
+    T copy(item);
+    return TryPush(std::move(copy));
+  }
+
+  // Returns false when the queue is empty.
+  bool TryPop(T* item) {
+    Slot* slot;
+    AtomicWord pos = NoBarrier_Load(&head_.value);
+    for (;;) {
+      slot = &slots_[pos & mask_];
+      AtomicWord diff = Acquire_Load(&slot->sequence) - (pos + 1);
+      if (diff == 0) {
+        AtomicWord claimed =
+            NoBarrier_CompareAndSwap(&head_.value, pos, pos + 1);
+        if (claimed == pos)
+          break;
+        pos = claimed;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = NoBarrier_Load(&head_.value);
+      }
+    }
+    *item = std::move(slot->value);
+    // Hand the slot to the producer one lap ahead.
+    Release_Store(&slot->sequence, pos + mask_ + 1);
+    return true;
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+  // Only a hint while other threads push or pop.
+  size_t ApproximateSize() const {
+    AtomicWord size = NoBarrier_Load(&tail_.value) -
+                      NoBarrier_Load(&head_.value);
+    return size < 0 ? 0 : static_cast<size_t>(size);
+  }
+
+ private:
+  struct Slot {
+    Slot() : sequence(0) {}
+    volatile AtomicWord sequence;
+    T value;
+  };
+  // A position alone on its cache line.
+  struct PaddedPosition {
+    PaddedPosition(AtomicWord initial) : value(initial) {}
+    volatile AtomicWord value;
+    char padding[64 - sizeof(AtomicWord)];
+  };
+
+  std::vector<Slot> slots_;
+  const AtomicWord mask_;
+  char padding_[64];
+  PaddedPosition head_;
+  PaddedPosition tail_;
+
+  DISALLOW_COPY_AND_ASSIGN(MpmcQueue);
+};
+
+// An MpmcQueue whose Push() waits while it is full and whose Pop() waits
+// while it is empty. Threads only sleep, on a Semaphore, when the queue
+// gives them no choice; while it is neither empty nor full a handoff costs
+// no system call.
+template <typename T>
+class BlockingMpmcQueue {
+ public:
+  explicit BlockingMpmcQueue(size_t capacity) : queue_(capacity) {}
+
+  void Push(T item) {
+    while (!queue_.TryPush(std::move(item))) {
+      not_full_.Prepare();
+      if (queue_.TryPush(std::move(item))) {
+        not_full_.Cancel();
+        break;
+      }
+      not_full_.Wait();
+    }
+    not_empty_.WakeOne();
+  }
+
+  void Pop(T* item) {
+    while (!queue_.TryPop(item)) {
+      not_empty_.Prepare();
+      if (queue_.TryPop(item)) {
+        not_empty_.Cancel();
+        break;
+      }
+      not_empty_.Wait();
+    }
+    not_full_.WakeOne();
+  }
+
+  bool TryPush(T item) {
+    if (!queue_.TryPush(std::move(item)))
+      return false;
+    not_empty_.WakeOne();
+    return true;
+  }
+
+  bool TryPop(T* item) {
+    if (!queue_.TryPop(item))
+      return false;
+    not_full_.WakeOne();
+    return true;
+  }
+
+  size_t capacity() const { return queue_.capacity(); }
+  size_t ApproximateSize() const { return queue_.ApproximateSize(); }
+
+ private:
+  MpmcQueue<T> queue_;
+  Waiters not_empty_;
+  Waiters not_full_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockingMpmcQueue);
+};
+
+} // namespace mrpc
+#endif // MRPC_BASE_MPMC_QUEUE_H_
@@ -0,0 +1,177 @@
+#include "base/mpmc_queue.h"
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include "base/thread.h"
+
+using namespace mrpc;
+
+namespace {
+
+const int kProducers = 4;
+const int kConsumers = 4;
+const int kItemsPerProducer = 50000;
+
+// Pushes |count| distinct values starting at |first|.
+template <typename Queue>
+class Producer : public Thread {
+ public:
+  Producer(Queue* queue, int first, int count)
+    : Thread(Options("producer")), queue_(queue), first_(first),
+      count_(count) {}
+
+  virtual void Run() override {
+    for (int i = first_; i < first_ + count_; ++i)
+      Push(queue_, i);
+  }
+
+ private:
+  static void Push(MpmcQueue<int>* queue, int value) {
+    while (!queue->TryPush(value))
+      Thread::YieldCurrentThread();
+  }
+  static void Push(BlockingMpmcQueue<int>* queue, int value) {
+    queue->Push(value);
+  }
+
+  Queue* queue_;
+  int first_;
+  int count_;
+};
+
+// Pops |count| values and counts how often each was seen.
+template <typename Queue>
+class Consumer : public Thread {
+ public:
+  Consumer(Queue* queue, int count, std::vector<int>* seen)
+    : Thread(Options("consumer")), queue_(queue), count_(count),
+      seen_(seen) {}
+
+  virtual void Run() override {
+    for (int i = 0; i < count_; ++i) {
+      int value = Pop(queue_);
+      ++(*seen_)[value];
+    }
+  }
+
+ private:
+  static int Pop(MpmcQueue<int>* queue) {
+    int value;
+    while (!queue->TryPop(&value))
+      Thread::YieldCurrentThread();
+    return value;
+  }
+  static int Pop(BlockingMpmcQueue<int>* queue) {
+    int value;
+    queue->Pop(&value);
+    return value;
+  }
+
+  Queue* queue_;
+  int count_;
+  std::vector<int>* seen_;
+};
+
+// Runs kProducers against kConsumers and checks every item arrived once.
+template <typename Queue>
+void TransferEveryItemOnce(Queue* queue) {
+  const int kItems = kProducers * kItemsPerProducer;
+  std::vector<std::vector<int> > seen(kConsumers, std::vector<int>(kItems));
+  std::vector<Thread*> threads;
+  for (int i = 0; i < kConsumers; ++i) {
+    threads.push_back(
+        new Consumer<Queue>(queue, kItems / kConsumers, &seen[i]));
+  }
+  for (int i = 0; i < kProducers; ++i) {
+    threads.push_back(new Producer<Queue>(queue, i * kItemsPerProducer,
+                                          kItemsPerProducer));
+  }
+  for (size_t i = 0; i < threads.size(); ++i)
+    threads[i]->Start();
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i]->Join();
+    delete threads[i];
+  }
+  int missing = 0;
+  for (int item = 0; item < kItems; ++item) {
+    int count = 0;
+    for (int i = 0; i < kConsumers; ++i)
+      count += seen[i][item];
+    if (count != 1)
+      ++missing;
+  }
+  EXPECT_EQ(0, missing);
+  EXPECT_EQ(0u, queue->ApproximateSize());
+}
+
+} // namespace
+
+TEST(MpmcQueueTest, FifoUntilFull) {
+  MpmcQueue<int> queue(4);
+  EXPECT_EQ(4u, queue.capacity());
+  int value;
+  EXPECT_FALSE(queue.TryPop(&value));
+  for (int lap = 0; lap < 3; ++lap) {
+    for (int i = 0; i < 4; ++i)
+      EXPECT_TRUE(queue.TryPush(i));
+    EXPECT_FALSE(queue.TryPush(4));
+    EXPECT_EQ(4u, queue.ApproximateSize());
+    for (int i = 0; i < 4; ++i) {
+      ASSERT_TRUE(queue.TryPop(&value));
+      EXPECT_EQ(i, value);
+    }
+    EXPECT_FALSE(queue.TryPop(&value));
+  }
+}
+
+TEST(MpmcQueueTest, MoveOnlyItems) {
+  MpmcQueue<std::unique_ptr<int> > queue(2);
+  std::unique_ptr<int> item(new int(7));
+  EXPECT_TRUE(queue.TryPush(std::move(item)));
+  EXPECT_TRUE(item == nullptr);
+  EXPECT_TRUE(queue.TryPush(std::unique_ptr<int>(new int(8))));
+  // A failed push leaves the item with the caller.
+  std::unique_ptr<int> rejected(new int(9));
+  EXPECT_FALSE(queue.TryPush(std::move(rejected)));
+  ASSERT_TRUE(rejected != nullptr);
+  std::unique_ptr<int> popped;
+  ASSERT_TRUE(queue.TryPop(&popped));
+  EXPECT_EQ(7, *popped);
+}
+
+TEST(MpmcQueueTest, TransfersEveryItemOnce) {
+  MpmcQueue<int> queue(64);
+  TransferEveryItemOnce(&queue);
+}
+
+TEST(BlockingMpmcQueueTest, TransfersEveryItemOnce) {
+  // Small enough that producers and consumers both sleep often.
+  BlockingMpmcQueue<int> queue(4);
+  TransferEveryItemOnce(&queue);
+}
+
+TEST(BlockingMpmcQueueTest, PopWaitsForPush) {
+  BlockingMpmcQueue<int> queue(2);
+  class Pusher : public Thread {
+   public:
+    explicit Pusher(BlockingMpmcQueue<int>* queue)
+      : Thread(Options("pusher")), queue_(queue) {}
+    virtual void Run() override {
+      Thread::Sleep(TimeDelta::FromMilliseconds(10));
+      for (int i = 0; i < 3; ++i)
+        queue_->Push(i);
+    }
+   private:
+    BlockingMpmcQueue<int>* queue_;
+  } pusher(&queue);
+  pusher.Start();
+  int value;
+  for (int i = 0; i < 3; ++i) {
+    queue.Pop(&value);
+    EXPECT_EQ(i, value);
+  }
+  pusher.Join();
+  EXPECT_FALSE(queue.TryPop(&value));
+}
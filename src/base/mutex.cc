@@ -1,6 +1,9 @@
 #include "base/mutex.h"
 #include <errno.h>
 
+#include "base/mutex_profiler.h"
+#include "base/time.h"
+
 namespace mrpc {
 
 static void InitializeNativeHandle(pthread_mutex_t* mutex) {
@@ -57,6 +60,14 @@ Mutex::~Mutex() {
 }
 
 void Mutex::Lock() {
+  if (MutexProfiler::enabled()) {
+    if (TryLockNativeHandle(&native_handle_))
+      return;
+    TimeTicks start = TimeTicks::HighResolutionNow();
+    LockNativeHandle(&native_handle_);
+    MutexProfiler::RecordContention(TimeTicks::HighResolutionNow() - start);
+    return;
+  }
   LockNativeHandle(&native_handle_);
 }
 
@@ -0,0 +1,261 @@
+#include "base/mutex_profiler.h"
+
+#include <execinfo.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+
+#include "base/futex_mutex.h"
+#include "base/mutex.h"
+
+namespace mrpc {
+
+namespace {
+
+// Samples each thread buffers between drains. A power of two.
+const int kBufferSize = 256;
+// backtrace() frames inside the profiler: RecordContention() and
+// Mutex::Lock().
+const int kSkippedFrames = 2;
+
+struct Sample {
+  int64_t wait_us;
+  int32_t weight;
+  int32_t depth;
+  void* frames[MutexProfiler::kMaxFrames];
+};
+
+struct Aggregate {
+  Aggregate() : contentions(0), total_wait_us(0), max_wait_us(0) {}
+  int64_t contentions;
+  int64_t total_wait_us;
+  int64_t max_wait_us;
+};
+
+typedef std::map<std::vector<void*>, Aggregate> SiteMap;
+
+} // namespace
+
+// A single-producer, single-consumer ring of Samples. The owning thread
+// pushes; whoever holds the registry lock pops, which is DrainBuffers() or
+// the owner itself once the ring is full.
+class MutexProfiler::ThreadBuffer {
+ public:
+  ThreadBuffer() : head_(0), tail_(0), contentions_(0), exited_(0) {}
+
+  // Owner only.
+  bool Push(const Sample& sample) {
+    AtomicWord tail = NoBarrier_Load(&tail_);
+    if (tail - Acquire_Load(&head_) == kBufferSize)
+      return false;
+    samples_[tail & (kBufferSize - 1)] = sample;
+    Release_Store(&tail_, tail + 1);
+    return true;
+  }
+  // Counts a contention and returns true if it should be sampled. Owner
+  // only.
+  bool ShouldSample(Atomic32 sample_period) {
+    return ++contentions_ % sample_period == 0;
+  }
+
+  // Consumer only.
+  void DrainInto(SiteMap* sites) {
+    AtomicWord head = NoBarrier_Load(&head_);
+    AtomicWord tail = Acquire_Load(&tail_);
+    for (; head != tail; ++head) {
+      const Sample& sample = samples_[head & (kBufferSize - 1)];
+      Aggregate& site = (*sites)[std::vector<void*>(
+          sample.frames, sample.frames + sample.depth)];
+      site.contentions += sample.weight;
+      site.total_wait_us += sample.wait_us * sample.weight;
+      site.max_wait_us = std::max(site.max_wait_us, sample.wait_us);
+    }
+    Release_Store(&head_, head);
+  }
+
+  bool exited() const { return Acquire_Load(&exited_) != 0; }
+
+  // Marks the buffer of an exiting thread for DrainBuffers() to free.
+  struct Owner {
+    Owner() : buffer(nullptr) {}
+    ~Owner() {
+      if (buffer)
+        Release_Store(&buffer->exited_, 1);
+    }
+    ThreadBuffer* buffer;
+  };
+  static thread_local Owner current_;
+
+ private:
+  volatile AtomicWord head_;
+  volatile AtomicWord tail_;
+  int64_t contentions_;
+  volatile Atomic32 exited_;
+  Sample samples_[kBufferSize];
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadBuffer);
+};
+
+thread_local MutexProfiler::ThreadBuffer::Owner
+    MutexProfiler::ThreadBuffer::current_;
+
+volatile Atomic32 MutexProfiler::sample_period_ = 0;
+std::vector<MutexProfiler::ThreadBuffer*>* MutexProfiler::thread_buffers_ =
+    NULL;
+
+// The profiler's own lock must not be a Mutex, or it would profile itself.
+static LazyFutexMutex registry_mutex = LAZY_FUTEX_MUTEX_INITIALIZER;
+static SiteMap* sites = NULL;
+static volatile AtomicWord dropped = 0;
+
+// static
+void MutexProfiler::Enable(int sample_period) {
+  DCHECK_GT(sample_period, 0);
+  // The first backtrace() may load libgcc and allocate; get that out of the
+  // way before a contended Lock() needs it.
+  void* frame;
+  backtrace(&frame, 1);
+  Release_Store(&sample_period_, sample_period);
+}
+
+// static
+void MutexProfiler::Disable() {
+  Release_Store(&sample_period_, 0);
+}
+
+// static
+MutexProfiler::ThreadBuffer* MutexProfiler::CurrentThreadBuffer() {
+  ThreadBuffer::Owner* owner = &ThreadBuffer::current_;
+  if (owner->buffer == nullptr) {
+    owner->buffer = new ThreadBuffer;
+    LockGuard<FutexMutex> lock(registry_mutex.Pointer());
+    if (thread_buffers_ == NULL)
+      thread_buffers_ = new std::vector<ThreadBuffer*>;
+    thread_buffers_->push_back(owner->buffer);
+  }
+  return owner->buffer;
+}
+
+// static
+void MutexProfiler::RecordContention(TimeDelta wait) {
+  Atomic32 sample_period = NoBarrier_Load(&sample_period_);
+  if (sample_period <= 0)
+    return;
+  ThreadBuffer* buffer = CurrentThreadBuffer();
+  if (!buffer->ShouldSample(sample_period))
+    return;
+  void* frames[kMaxFrames + kSkippedFrames];
+  int depth = backtrace(frames, kMaxFrames + kSkippedFrames) - kSkippedFrames;
+  Sample sample;
+  sample.wait_us = wait.InMicroseconds();
+  sample.weight = sample_period;
+  sample.depth = std::max(depth, 0);
+  std::copy(frames + kSkippedFrames, frames + kSkippedFrames + sample.depth,
+            sample.frames);
+  if (buffer->Push(sample))
+    return;
+  // The buffer is full: move its samples into the site table, unless a drain
+  // is already under way, which should not hold up a thread that just got
+  // its lock.
+  FutexMutex* mutex = registry_mutex.Pointer();
+  if (mutex->TryLock()) {
+    if (sites == NULL)
+      sites = new SiteMap;
+    buffer->DrainInto(sites);
+    mutex->Unlock();
+    if (buffer->Push(sample))
+      return;
+  }
+  Barrier_AtomicIncrement(&dropped, 1);
+}
+
+// static
+void MutexProfiler::DrainBuffers() {
+  if (thread_buffers_ == NULL)
+    return;
+  if (sites == NULL)
+    sites = new SiteMap;
+  std::vector<ThreadBuffer*>::iterator it = thread_buffers_->begin();
+  while (it != thread_buffers_->end()) {
+    // Read exited() first: a buffer that has exited gets no more samples.
+    bool exited = (*it)->exited();
+    (*it)->DrainInto(sites);
+    if (exited) {
+      delete *it;
+      it = thread_buffers_->erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+// static
+void MutexProfiler::GetSites(std::vector<Site>* result) {
+  result->clear();
+  {
+    LockGuard<FutexMutex> lock(registry_mutex.Pointer());
+    DrainBuffers();
+    if (sites == NULL)
+      return;
+    for (SiteMap::const_iterator it = sites->begin(); it != sites->end();
+         ++it) {
+      Site site;
+      site.stack = it->first;
+      site.contentions = it->second.contentions;
+      site.total_wait = TimeDelta::FromMicroseconds(it->second.total_wait_us);
+      site.max_wait = TimeDelta::FromMicroseconds(it->second.max_wait_us);
+      result->push_back(site);
+    }
+  }
+  std::sort(result->begin(), result->end(),
+            [](const Site& a, const Site& b) {
+              return a.total_wait > b.total_wait;
+            });
+}
+
+// static
+std::string MutexProfiler::Dump() {
+  std::vector<Site> sites;
+  GetSites(&sites);
+  std::ostringstream out;
+  out << "Mutex contention: " << sites.size() << " sites, sample period "
+      << NoBarrier_Load(&sample_period_) << ", " << dropped_samples()
+      << " samples dropped\n";
+  for (size_t i = 0; i < sites.size(); ++i) {
+    const Site& site = sites[i];
+    out << "total " << site.total_wait.InMicroseconds() << "us, max "
+        << site.max_wait.InMicroseconds() << "us, " << site.contentions
+        << " contentions\n";
+    if (site.stack.empty())
+      continue;
+    char** symbols = backtrace_symbols(&site.stack[0], site.stack.size());
+    for (size_t j = 0; j < site.stack.size(); ++j) {
+      out << "    ";
+      if (symbols)
+        out << symbols[j];
+      else
+        out << site.stack[j];
+      out << "\n";
+    }
+    free(symbols);
+  }
+  return out.str();
+}
+
+// static
+void MutexProfiler::Reset() {
+  LockGuard<FutexMutex> lock(registry_mutex.Pointer());
+  DrainBuffers();
+  if (sites)
+    sites->clear();
+  Release_Store(&dropped, 0);
+}
+
+// static
+int64_t MutexProfiler::dropped_samples() {
+  return Acquire_Load(&dropped);
+}
+
+} // namespace mrpc
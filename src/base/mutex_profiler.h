@@ -0,0 +1,75 @@
+#ifndef MRPC_BASE_MUTEX_PROFILER_H_
+#define MRPC_BASE_MUTEX_PROFILER_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/macros.h"
+#include "base/time.h"
+
+namespace mrpc {
+
+// Opt-in contention profiling for Mutex.
+//
+// While enabled, Mutex::Lock() first tries TryLock(). When that fails it
+// times the wait with TimeTicks::HighResolutionNow() and, for one in every
+// |sample_period| contended acquisitions, captures the call stack. Samples
+// go to a lock-free buffer owned by the waiting thread, so recording takes
+// no lock; GetSites() and Dump() drain every buffer and aggregate the
+// samples per call site, scaled back up by the sample period. A thread whose
+// buffer fills up drains it into the aggregate itself.
+//
+// A sample is only dropped, and counted in dropped_samples(), if its
+// thread's buffer is full while another drain is under way.
+//
+// ConditionVariable waits are not profiled: they are meant to block, and
+// pthread_cond_wait() reacquires the mutex without a separate contended
+// Lock() to time.
+class MutexProfiler {
+ public:
+  struct Site {
+    // Return addresses, innermost first, starting at Mutex::Lock()'s caller.
+    std::vector<void*> stack;
+    int64_t contentions;
+    TimeDelta total_wait;
+    TimeDelta max_wait;
+  };
+
+  // Starts recording one in every |sample_period| contentions per thread.
+  static void Enable(int sample_period = 1);
+  static void Disable();
+  static bool enabled() { return NoBarrier_Load(&sample_period_) > 0; }
+
+  // Every site seen since the last Reset(), by total wait, longest first.
+  static void GetSites(std::vector<Site>* sites);
+  // GetSites() as text, with symbolized stacks.
+  static std::string Dump();
+  // Forgets every site seen so far.
+  static void Reset();
+  static int64_t dropped_samples();
+
+  // Called by Mutex::Lock() after waiting |wait| for a contended lock.
+  static void RecordContention(TimeDelta wait);
+
+  static const int kMaxFrames = 8;
+
+ private:
+  class ThreadBuffer;
+
+  static ThreadBuffer* CurrentThreadBuffer();
+  // Moves the samples of every thread into the aggregate. Called with the
+  // registry lock held.
+  static void DrainBuffers();
+
+  static volatile Atomic32 sample_period_;
+  // Every thread's buffer, protected by the registry lock.
+  static std::vector<ThreadBuffer*>* thread_buffers_;
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(MutexProfiler);
+};
+
+} // namespace mrpc
+#endif // MRPC_BASE_MUTEX_PROFILER_H_
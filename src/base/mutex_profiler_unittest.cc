@@ -0,0 +1,138 @@
+#include "base/mutex_profiler.h"
+#include <gtest/gtest.h>
+
+#include "base/mutex.h"
+#include "base/semaphore.h"
+#include "base/thread.h"
+
+using namespace mrpc;
+
+namespace {
+
+// Locks |mutex| while another thread holds it for |hold|.
+class Contender : public Thread {
+ public:
+  Contender(Mutex* mutex, TimeDelta hold)
+    : Thread(Options("contender")), mutex_(mutex), hold_(hold) {}
+
+  // Starts Run() while the mutex is held, so that it has to wait.
+  void HoldAndStart() {
+    mutex_->Lock();
+    Start();
+    Thread::Sleep(hold_);
+    mutex_->Unlock();
+  }
+
+  virtual void Run() override {
+    LockGuard<Mutex> lock_guard(mutex_);
+  }
+
+ private:
+  Mutex* mutex_;
+  TimeDelta hold_;
+};
+
+int64_t TotalContentions(const std::vector<MutexProfiler::Site>& sites) {
+  int64_t contentions = 0;
+  for (size_t i = 0; i < sites.size(); ++i)
+    contentions += sites[i].contentions;
+  return contentions;
+}
+
+void Contend(Mutex* mutex, int times) {
+  for (int i = 0; i < times; ++i) {
+    Contender contender(mutex, TimeDelta::FromMilliseconds(10));
+    contender.HoldAndStart();
+    contender.Join();
+  }
+}
+
+} // namespace
+
+TEST(MutexProfilerTest, DisabledRecordsNothing) {
+  MutexProfiler::Reset();
+  Mutex mutex;
+  Contend(&mutex, 1);
+  std::vector<MutexProfiler::Site> sites;
+  MutexProfiler::GetSites(&sites);
+  EXPECT_TRUE(sites.empty());
+}
+
+TEST(MutexProfilerTest, RecordsContendedLocks) {
+  MutexProfiler::Enable();
+  MutexProfiler::Reset();
+  Mutex mutex;
+  // Uncontended locks are not recorded.
+  for (int i = 0; i < 100; ++i) {
+    LockGuard<Mutex> lock_guard(&mutex);
+  }
+  Contend(&mutex, 2);
+  MutexProfiler::Disable();
+
+  std::vector<MutexProfiler::Site> sites;
+  MutexProfiler::GetSites(&sites);
+  ASSERT_EQ(1u, sites.size());
+  EXPECT_EQ(2, sites[0].contentions);
+  EXPECT_FALSE(sites[0].stack.empty());
+  EXPECT_GE(sites[0].max_wait, TimeDelta::FromMilliseconds(5));
+  EXPECT_GE(sites[0].total_wait, sites[0].max_wait);
+  EXPECT_NE(std::string::npos,
+            MutexProfiler::Dump().find("2 contentions"));
+
+  MutexProfiler::Reset();
+  MutexProfiler::GetSites(&sites);
+  EXPECT_TRUE(sites.empty());
+}
+
+TEST(MutexProfilerTest, SamplingScalesCounts) {
+  MutexProfiler::Enable(2);
+  MutexProfiler::Reset();
+  Mutex mutex;
+  // Sampling counts per thread, so all the contention comes from one.
+  Semaphore contended(0);
+  class Waiter : public Thread {
+   public:
+    Waiter(Mutex* mutex, Semaphore* contended)
+      : Thread(Options("waiter")), mutex_(mutex), contended_(contended) {}
+    virtual void Run() override {
+      for (int i = 0; i < 4; ++i) {
+        contended_->Wait();
+        LockGuard<Mutex> lock_guard(mutex_);
+      }
+    }
+   private:
+    Mutex* mutex_;
+    Semaphore* contended_;
+  } waiter(&mutex, &contended);
+  waiter.Start();
+  for (int i = 0; i < 4; ++i) {
+    mutex.Lock();
+    contended.Signal();
+    Thread::Sleep(TimeDelta::FromMilliseconds(10));
+    mutex.Unlock();
+    Thread::Sleep(TimeDelta::FromMilliseconds(1));
+  }
+  waiter.Join();
+  MutexProfiler::Disable();
+
+  std::vector<MutexProfiler::Site> sites;
+  MutexProfiler::GetSites(&sites);
+  EXPECT_EQ(4, TotalContentions(sites));
+  EXPECT_EQ(0, MutexProfiler::dropped_samples());
+  MutexProfiler::Reset();
+}
+
+TEST(MutexProfilerTest, FullBufferIsDrainedNotDropped) {
+  MutexProfiler::Enable();
+  MutexProfiler::Reset();
+  // Far more than a thread buffers between drains.
+  for (int i = 0; i < 1000; ++i)
+    MutexProfiler::RecordContention(TimeDelta::FromMicroseconds(1));
+  MutexProfiler::Disable();
+
+  std::vector<MutexProfiler::Site> sites;
+  MutexProfiler::GetSites(&sites);
+  EXPECT_EQ(1000, TotalContentions(sites));
+  EXPECT_EQ(0, MutexProfiler::dropped_samples());
+  MutexProfiler::Reset();
+}
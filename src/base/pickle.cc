@@ -5,6 +5,7 @@
 #include <algorithm>  // for max()
 #include <limits>
 
+#include "base/arena.h"
 #include "base/bits.h"
 #include "base/macros.h"
 
@@ -15,10 +16,53 @@ const int Pickle::kPayloadUnit = 64;
 
 static const size_t kCapacityReadOnly = static_cast<size_t>(-1);
 
+// Arena-backed buffers are aligned like malloc()'d ones, so that arrays read
+// in place with ReadSpan() behave the same whichever way a Pickle allocates.
+static const int kArenaBufferAlignment = ALIGNOF(max_align_t);
+
+// A 64-bit LEB128 varint takes at most ten bytes.
+static const size_t kMaxVarintBytes = 10;
+
+static inline uint32_t ZigZagEncode32(int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^
+         static_cast<uint32_t>(value >> 31);
+}
+
+static inline uint64_t ZigZagEncode64(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+static inline int32_t ZigZagDecode32(uint32_t value) {
+  return static_cast<int32_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+static inline int64_t ZigZagDecode64(uint64_t value) {
+  return static_cast<int64_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+static inline size_t VarintSize(uint64_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+static inline size_t FormatAlignment(PickleFormat format) {
+  return format == PICKLE_COMPACT ? 1 : sizeof(uint32_t);
+}
+
 PickleIterator::PickleIterator(const Pickle& pickle)
-    : payload_(pickle.payload()),
+    : pickle_(&pickle),
+      payload_(pickle.payload()),
       read_index_(0),
-      end_index_(pickle.payload_size()) {
+      end_index_(pickle.payload_size()),
+      alignment_(pickle.alignment_),
+      payload_offset_(pickle.header_size_),
+      next_segment_(NULL),
+      end_segment_(NULL) {
 }
 
 template <typename Type>
@@ -26,15 +70,14 @@ inline bool PickleIterator::ReadBuiltinType(Type* result) {
   const char* read_from = GetReadPointerAndAdvance<Type>();
   if (!read_from)
     return false;
-  if (sizeof(Type) > sizeof(uint32_t))
-    memcpy(result, read_from, sizeof(*result));
-  else
-    *result = *reinterpret_cast<const Type*>(read_from);
+  // Fields of a compact pickle are not aligned, so always go through memcpy;
+  // it compiles down to a single load.
+  memcpy(result, read_from, sizeof(*result));
   return true;
 }
 
 inline void PickleIterator::Advance(size_t size) {
-  size_t aligned_size = bits::Align(size, sizeof(uint32_t));
+  size_t aligned_size = bits::Align(size, alignment_);
   if (end_index_ - read_index_ < aligned_size) {
     read_index_ = end_index_;
   } else {
@@ -42,9 +85,26 @@ inline void PickleIterator::Advance(size_t size) {
   }
 }
 
+bool PickleIterator::NextSegment(size_t num_bytes) {
+  // Writers never split a field, so a read that does not fit in what is left
+  // of the current segment is only valid at a segment boundary.
+  while (read_index_ == end_index_ && next_segment_ != end_segment_) {
+    payload_offset_ += end_index_;
+    payload_ = static_cast<const char*>(next_segment_->iov_base);
+    read_index_ = 0;
+    end_index_ = next_segment_->iov_len;
+    ++next_segment_;
+    if (end_index_ >= num_bytes)
+      return true;
+  }
+  // Like a contiguous Pickle, a failed read ends iteration.
+  next_segment_ = end_segment_;
+  return false;
+}
+
 template<typename Type>
 inline const char* PickleIterator::GetReadPointerAndAdvance() {
-  if (sizeof(Type) > end_index_ - read_index_) {
+  if (sizeof(Type) > end_index_ - read_index_ && !NextSegment(sizeof(Type))) {
     read_index_ = end_index_;
     return NULL;
   }
@@ -55,7 +115,8 @@ inline const char* PickleIterator::GetReadPointerAndAdvance() {
 
 const char* PickleIterator::GetReadPointerAndAdvance(int num_bytes) {
   if (num_bytes < 0 ||
-      end_index_ - read_index_ < static_cast<size_t>(num_bytes)) {
+      (end_index_ - read_index_ < static_cast<size_t>(num_bytes) &&
+       !NextSegment(num_bytes))) {
     read_index_ = end_index_;
     return NULL;
   }
@@ -76,7 +137,19 @@ inline const char* PickleIterator::GetReadPointerAndAdvance(
 }
 
 bool PickleIterator::ReadBool(bool* result) {
-  return ReadBuiltinType(result);
+  // Compact pickles write bools as varints, aligned ones as ints.
+  if (alignment_ == 1) {
+    uint32_t value;
+    if (!ReadVarUInt32(&value))
+      return false;
+    *result = value != 0;
+    return true;
+  }
+  int value;
+  if (!ReadBuiltinType(&value))
+    return false;
+  *result = value != 0;
+  return true;
 }
 
 bool PickleIterator::ReadInt(int* result) {
@@ -177,7 +250,99 @@ bool PickleIterator::ReadBytes(const char** data, int length) {
   return true;
 }
 
-PickleSizer::PickleSizer() {}
+const char* PickleIterator::GetArrayPointerAndAdvance(
+    int* count,
+    size_t element_size,
+    size_t element_alignment) {
+  int length;
+  if (!ReadLength(&length))
+    return NULL;
+  // Padding is relative to the start of the pickle, as in WriteArray().
+  size_t offset = payload_offset_ + read_index_;
+  size_t padding = bits::Align(offset, element_alignment) - offset;
+  // Offsets run on across the segments of a ChainedPickle, so the padding is
+  // the same whichever segment it lands in.
+  if (padding > end_index_ - read_index_ && !NextSegment(padding)) {
+    read_index_ = end_index_;
+    return NULL;
+  }
+  read_index_ += padding;
+  const char* read_from = GetReadPointerAndAdvance(length, element_size);
+  if (!read_from ||
+      (reinterpret_cast<uintptr_t>(read_from) & (element_alignment - 1)))
+    return NULL;
+  *count = length;
+  return read_from;
+}
+
+bool PickleIterator::ReadVarInt32(int32_t* result) {
+  uint32_t value;
+  if (!ReadVarUInt32(&value))
+    return false;
+  *result = ZigZagDecode32(value);
+  return true;
+}
+
+bool PickleIterator::ReadVarInt64(int64_t* result) {
+  uint64_t value;
+  if (!ReadVarUInt64(&value))
+    return false;
+  *result = ZigZagDecode64(value);
+  return true;
+}
+
+bool PickleIterator::ReadVarUInt32(uint32_t* result) {
+  uint64_t value;
+  if (!ReadVarUInt64(&value) || value > std::numeric_limits<uint32_t>::max())
+    return false;
+  *result = static_cast<uint32_t>(value);
+  return true;
+}
+
+bool PickleIterator::ReadVarUInt64(uint64_t* result) {
+  if (read_index_ == end_index_ && !NextSegment(1))
+    return false;
+  const uint8_t* read_from =
+      reinterpret_cast<const uint8_t*>(payload_ + read_index_);
+  size_t available = std::min(end_index_ - read_index_, kMaxVarintBytes);
+  uint64_t value = 0;
+  for (size_t i = 0; i < available; ++i) {
+    // The tenth byte only holds bit 63 and must end the varint; anything
+    // else is overlong or overflows.
+    if (i == kMaxVarintBytes - 1 && read_from[i] > 1)
+      break;
+    value |= static_cast<uint64_t>(read_from[i] & 0x7f) << (7 * i);
+    if (!(read_from[i] & 0x80)) {
+      *result = value;
+      Advance(i + 1);
+      return true;
+    }
+  }
+  read_index_ = end_index_;
+  return false;
+}
+
+bool PickleIterator::ReadAttachment(scoped_refptr<PickleAttachment>* result) {
+  return pickle_ && pickle_->ReadAttachment(this, result);
+}
+
+bool PickleIterator::ReadBuffer(scoped_refptr<PickleBufferAttachment>* result) {
+  return pickle_ && pickle_->ReadBuffer(this, result);
+}
+
+PickleSizer::PickleSizer()
+    : header_size_(sizeof(Pickle::Header)),
+      alignment_(sizeof(uint32_t)) {}
+
+PickleSizer::PickleSizer(PickleFormat format)
+    : header_size_(sizeof(Pickle::Header)),
+      alignment_(FormatAlignment(format)) {
+}
+
+PickleSizer::PickleSizer(int header_size)
+    : header_size_(bits::Align(header_size, sizeof(uint32_t))),
+      alignment_(sizeof(uint32_t)) {
+}
 
 PickleSizer::~PickleSizer() {}
 
@@ -193,7 +358,29 @@ void PickleSizer::AddData(int length) {
 }
 
 void PickleSizer::AddBytes(int length) {
-  payload_size_ += bits::Align(length, sizeof(uint32_t));
+  payload_size_ += bits::Align(length, alignment_);
+}
+
+void PickleSizer::AddArrayCommon(int count,
+                                 size_t element_size,
+                                 size_t element_alignment) {
+  CHECK_GE(count, 0);
+  AddInt();
+  size_t offset = header_size_ + payload_size_;
+  size_t padding = bits::Align(offset, element_alignment) - offset;
+  AddBytes(static_cast<int>(padding + element_size * count));
+}
+
+void PickleSizer::AddVarInt32(int32_t value) {
+  AddVarUInt64(ZigZagEncode32(value));
+}
+
+void PickleSizer::AddVarInt64(int64_t value) {
+  AddVarUInt64(ZigZagEncode64(value));
+}
+
+void PickleSizer::AddVarUInt64(uint64_t value) {
+  AddBytes(static_cast<int>(VarintSize(value)));
 }
 
 template <size_t length> void PickleSizer::AddBytesStatic() {
@@ -205,9 +392,32 @@ template void PickleSizer::AddBytesStatic<2>();
 template void PickleSizer::AddBytesStatic<4>();
 template void PickleSizer::AddBytesStatic<8>();
 
-Pickle::Attachment::Attachment() {}
+PickleAttachment::PickleAttachment() {}
+
+PickleAttachment::~PickleAttachment() {}
+
+PickleAttachment::Type PickleAttachment::GetType() const {
+  return TYPE_OPAQUE;
+}
+
+PickleBufferAttachment::PickleBufferAttachment(std::string* data)
+    : data_(NULL),
+      size_(0) {
+  storage_.swap(*data);
+  data_ = storage_.data();
+  size_ = storage_.size();
+}
+
+PickleBufferAttachment::PickleBufferAttachment(const char* data, size_t size)
+    : data_(data),
+      size_(size) {
+}
+
+PickleBufferAttachment::~PickleBufferAttachment() {}
 
-Pickle::Attachment::~Attachment() {}
+PickleAttachment::Type PickleBufferAttachment::GetType() const {
+  return TYPE_BUFFER;
+}
 
 // Payload is uint32_t aligned.
 
@@ -215,7 +425,9 @@ Pickle::Pickle()
     : header_(NULL),
       header_size_(sizeof(Header)),
       capacity_after_header_(0),
-      write_offset_(0) {
+      write_offset_(0),
+      arena_(NULL),
+      alignment_(sizeof(uint32_t)) {
   static_assert((Pickle::kPayloadUnit & (Pickle::kPayloadUnit - 1)) == 0,
                 "Pickle::kPayloadUnit must be a power of two");
   Resize(kPayloadUnit);
@@ -226,20 +438,47 @@ Pickle::Pickle(int header_size)
     : header_(NULL),
       header_size_(bits::Align(header_size, sizeof(uint32_t))),
       capacity_after_header_(0),
-      write_offset_(0) {
+      write_offset_(0),
+      arena_(NULL),
+      alignment_(sizeof(uint32_t)) {
   DCHECK_GE(static_cast<size_t>(header_size), sizeof(Header));
   DCHECK_LE(header_size, kPayloadUnit);
   Resize(kPayloadUnit);
   header_->payload_size = 0;
 }
 
+Pickle::Pickle(BaseArena* arena)
+    : header_(NULL),
+      header_size_(sizeof(Header)),
+      capacity_after_header_(0),
+      write_offset_(0),
+      arena_(arena),
+      alignment_(sizeof(uint32_t)) {
+  DCHECK(arena_);
+  Resize(kPayloadUnit);
+  header_->payload_size = 0;
+}
+
+Pickle::Pickle(PickleFormat format)
+    : header_(NULL),
+      header_size_(sizeof(Header)),
+      capacity_after_header_(0),
+      write_offset_(0),
+      arena_(NULL),
+      alignment_(FormatAlignment(format)) {
+  Resize(kPayloadUnit);
+  header_->payload_size = format == PICKLE_COMPACT ? kCompactFlag : 0;
+}
+
 Pickle::Pickle(const char* data, int data_len)
     : header_(reinterpret_cast<Header*>(const_cast<char*>(data))),
       header_size_(0),
       capacity_after_header_(kCapacityReadOnly),
-      write_offset_(0) {
+      write_offset_(0),
+      arena_(NULL),
+      alignment_(sizeof(uint32_t)) {
   if (data_len >= static_cast<int>(sizeof(Header)))
-    header_size_ = data_len - header_->payload_size;
+    header_size_ = data_len - payload_size();
 
   if (header_size_ > static_cast<unsigned int>(data_len))
     header_size_ = 0;
@@ -250,20 +489,25 @@ Pickle::Pickle(const char* data, int data_len)
   // If there is anything wrong with the data, we're not going to use it.
   if (!header_size_)
     header_ = NULL;
+  else if (header_->payload_size & kCompactFlag)
+    alignment_ = 1;
 }
 
 Pickle::Pickle(const Pickle& other)
     : header_(NULL),
       header_size_(other.header_size_),
       capacity_after_header_(0),
-      write_offset_(other.write_offset_) {
-  Resize(other.header_->payload_size);
-  memcpy(header_, other.header_, header_size_ + other.header_->payload_size);
+      write_offset_(other.write_offset_),
+      arena_(NULL),
+      alignment_(other.alignment_),
+      attachments_(other.attachments_) {
+  Resize(other.payload_size());
+  memcpy(header_, other.header_, header_size_ + other.payload_size());
 }
 
 Pickle::~Pickle() {
   if (capacity_after_header_ != kCapacityReadOnly)
-    free(header_);
+    FreeBuffer();
 }
 
 Pickle& Pickle::operator=(const Pickle& other) {
@@ -276,14 +520,16 @@ Pickle& Pickle::operator=(const Pickle& other) {
     capacity_after_header_ = 0;
   }
   if (header_size_ != other.header_size_) {
-    free(header_);
+    FreeBuffer();
     header_ = NULL;
     header_size_ = other.header_size_;
   }
-  Resize(other.header_->payload_size);
+  Resize(other.payload_size());
   memcpy(header_, other.header_,
-         other.header_size_ + other.header_->payload_size);
+         other.header_size_ + other.payload_size());
   write_offset_ = other.write_offset_;
+  alignment_ = other.alignment_;
+  attachments_ = other.attachments_;
   return *this;
 }
 
@@ -303,8 +549,50 @@ bool Pickle::WriteBytes(const void* data, int length) {
   return true;
 }
 
+bool Pickle::WriteVarInt32(int32_t value) {
+  return WriteVarUInt64(ZigZagEncode32(value));
+}
+
+bool Pickle::WriteVarInt64(int64_t value) {
+  return WriteVarUInt64(ZigZagEncode64(value));
+}
+
+bool Pickle::WriteVarUInt64(uint64_t value) {
+  uint8_t buffer[kMaxVarintBytes];
+  size_t length = 0;
+  while (value >= 0x80) {
+    buffer[length++] = static_cast<uint8_t>(value) | 0x80;
+    value >>= 7;
+  }
+  buffer[length++] = static_cast<uint8_t>(value);
+  WriteBytesCommon(buffer, length);
+  return true;
+}
+
+bool Pickle::WriteArrayCommon(const void* data,
+                              int count,
+                              size_t element_size,
+                              size_t element_alignment) {
+  if (count < 0 ||
+      static_cast<size_t>(count) >
+          std::numeric_limits<int>::max() / element_size)
+    return false;
+  if (!WriteInt(count))
+    return false;
+  // Align the elements relative to the start of the pickle, so that they can
+  // be read in place from any buffer that is itself aligned.
+  size_t offset = header_size_ + write_offset_;
+  size_t padding = bits::Align(offset, element_alignment) - offset;
+  size_t num_bytes = element_size * count;
+  char* write = static_cast<char*>(
+      ClaimUninitializedBytesInternal(padding + num_bytes));
+  memset(write, 0, padding);
+  memcpy(write + padding, data, num_bytes);
+  return true;
+}
+
 void Pickle::Reserve(size_t length) {
-  size_t data_len = bits::Align(length, sizeof(uint32_t));
+  size_t data_len = bits::Align(length, alignment_);
   DCHECK_GE(data_len, length);
   DCHECK_LE(data_len, std::numeric_limits<uint32_t>::max());
   DCHECK_LE(write_offset_, std::numeric_limits<uint32_t>::max() - data_len);
@@ -314,26 +602,75 @@ void Pickle::Reserve(size_t length) {
 }
 
 bool Pickle::WriteAttachment(scoped_refptr<Attachment> attachment) {
-  return false;
+  if (!attachment.get() ||
+      attachments_.size() >= std::numeric_limits<uint32_t>::max())
+    return false;
+  if (!WriteUInt32(static_cast<uint32_t>(attachments_.size())))
+    return false;
+  attachments_.push_back(attachment);
+  return true;
 }
 
 bool Pickle::ReadAttachment(PickleIterator* iter,
                             scoped_refptr<Attachment>* attachment) const {
-  return false;
+  uint32_t index;
+  if (!iter->ReadUInt32(&index) || index >= attachments_.size())
+    return false;
+  *attachment = attachments_[index];
+  return true;
 }
 
 bool Pickle::HasAttachments() const {
-  return false;
+  return !attachments_.empty();
+}
+
+bool Pickle::WriteBuffer(scoped_refptr<BufferAttachment> buffer) {
+  if (!buffer.get() || buffer->size() > std::numeric_limits<uint32_t>::max())
+    return false;
+  uint32_t length = static_cast<uint32_t>(buffer->size());
+  return WriteAttachment(buffer) && WriteUInt32(length);
+}
+
+bool Pickle::ReadBuffer(PickleIterator* iter,
+                        scoped_refptr<BufferAttachment>* buffer) const {
+  scoped_refptr<Attachment> attachment;
+  uint32_t length;
+  if (!ReadAttachment(iter, &attachment) || !iter->ReadUInt32(&length))
+    return false;
+  if (attachment->GetType() != Attachment::TYPE_BUFFER)
+    return false;
+  BufferAttachment* result = static_cast<BufferAttachment*>(attachment.get());
+  if (result->size() != length)
+    return false;
+  *buffer = result;
+  return true;
 }
 
 void Pickle::Resize(size_t new_capacity) {
   CHECK_NE(capacity_after_header_, kCapacityReadOnly);
+  size_t old_size = header_ ? GetTotalAllocatedSize() : 0;
   capacity_after_header_ = bits::Align(new_capacity, kPayloadUnit);
-  void* p = realloc(header_, GetTotalAllocatedSize());
+  void* p;
+  if (arena_) {
+    p = arena_->SlowReallocAligned(reinterpret_cast<char*>(header_), old_size,
+                                   GetTotalAllocatedSize(),
+                                   kArenaBufferAlignment);
+  } else {
+    p = realloc(header_, GetTotalAllocatedSize());
+  }
   CHECK(p);
   header_ = reinterpret_cast<Header*>(p);
 }
 
+void Pickle::FreeBuffer() {
+  if (!arena_) {
+    free(header_);
+  } else if (header_) {
+    // Gives the space back if nothing was allocated from the arena since.
+    arena_->SlowFree(header_, GetTotalAllocatedSize());
+  }
+}
+
 void* Pickle::ClaimBytes(size_t num_bytes) {
   void* p = ClaimUninitializedBytesInternal(num_bytes);
   CHECK(p);
@@ -378,12 +715,13 @@ bool Pickle::PeekNext(size_t header_size,
   if (length < header_size)
     return false;
 
-  if (hdr->payload_size > std::numeric_limits<size_t>::max() - header_size) {
+  size_t payload_size = hdr->payload_size & ~kCompactFlag;
+  if (payload_size > std::numeric_limits<size_t>::max() - header_size) {
     // If payload_size causes an overflow, we return maximum possible
     // pickle size to indicate that.
     *pickle_size = std::numeric_limits<size_t>::max();
   } else {
-    *pickle_size = header_size + hdr->payload_size;
+    *pickle_size = header_size + payload_size;
   }
   return true;
 }
@@ -399,10 +737,10 @@ template void Pickle::WriteBytesStatic<8>(const void* data);
 inline void* Pickle::ClaimUninitializedBytesInternal(size_t length) {
   DCHECK_NE(kCapacityReadOnly, capacity_after_header_)
       << "oops: pickle is readonly";
-  size_t data_len = bits::Align(length, sizeof(uint32_t));
+  size_t data_len = bits::Align(length, alignment_);
   DCHECK_GE(data_len, length);
-  DCHECK_LE(data_len, std::numeric_limits<uint32_t>::max());
-  DCHECK_LE(write_offset_, std::numeric_limits<uint32_t>::max() - data_len);
+  DCHECK_LE(data_len, kCompactFlag - 1);
+  DCHECK_LE(write_offset_, kCompactFlag - 1 - data_len);
   size_t new_size = write_offset_ + data_len;
   if (new_size > capacity_after_header_) {
     size_t new_capacity = capacity_after_header_ * 2;
@@ -414,7 +752,8 @@ inline void* Pickle::ClaimUninitializedBytesInternal(size_t length) {
 
   char* write = mutable_payload() + write_offset_;
   memset(write + length, 0, data_len - length);  // Always initialize padding
-  header_->payload_size = static_cast<uint32_t>(new_size);
+  header_->payload_size = static_cast<uint32_t>(new_size) |
+                          (header_->payload_size & kCompactFlag);
   write_offset_ = new_size;
   return write;
 }
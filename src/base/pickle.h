@@ -3,8 +3,11 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include <string>
+#include <type_traits>
+#include <vector>
 
 #include "base/macros.h"
 #include <glog/logging.h>
@@ -13,14 +16,88 @@
 
 namespace mrpc {
 
+class BaseArena;
 class Pickle;
+class ChainedPickle;
+
+namespace internal {
+class PickleSchemaAccess;
+}  // namespace internal
+
+// Wire formats of a Pickle payload. PICKLE_ALIGNED pads every field to four
+// bytes. PICKLE_COMPACT packs fields without padding, which pairs with the
+// varint writers to keep messages of small integers small, and writes bools
+// as a single byte; it is flagged in the header so readers pick it up
+// automatically.
+enum PickleFormat {
+  PICKLE_ALIGNED,
+  PICKLE_COMPACT,
+};
+
+// An object that travels alongside a Pickle rather than inside its payload.
+// The payload only records the attachment's index in the pickle's attachment
+// table.
+class PickleAttachment : public RefCountedThreadSafe<PickleAttachment> {
+ public:
+  enum Type {
+    TYPE_OPAQUE,
+    TYPE_BUFFER,
+  };
+
+  PickleAttachment();
+
+  virtual Type GetType() const;
+
+ protected:
+  friend class RefCountedThreadSafe<PickleAttachment>;
+  virtual ~PickleAttachment();
+
+  DISALLOW_COPY_AND_ASSIGN(PickleAttachment);
+};
+
+// A block of bytes passed by reference instead of being copied into the
+// payload. Use it for large blobs such as file chunks or cached values.
+class PickleBufferAttachment : public PickleAttachment {
+ public:
+  // Takes over the contents of |*data|, leaving it empty.
+  explicit PickleBufferAttachment(std::string* data);
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+  Type GetType() const override;
+
+ protected:
+  // For subclasses that keep |data| alive by other means, e.g. a mapped file.
+  PickleBufferAttachment(const char* data, size_t size);
+  ~PickleBufferAttachment() override;
+
+ private:
+  std::string storage_;
+  const char* data_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(PickleBufferAttachment);
+};
 
 // PickleIterator reads data from a Pickle. The Pickle object must remain valid
 // while the PickleIterator object is in use.
 class  PickleIterator {
  public:
-  PickleIterator() : payload_(NULL), read_index_(0), end_index_(0) {}
+  PickleIterator()
+      : pickle_(NULL),
+        payload_(NULL),
+        read_index_(0),
+        end_index_(0),
+        alignment_(sizeof(uint32_t)),
+        payload_offset_(0),
+        next_segment_(NULL),
+        end_segment_(NULL) {}
   explicit PickleIterator(const Pickle& pickle);
+  // Reads a ChainedPickle segment by segment. Fields are never split across
+  // segments, so pointers returned by ReadBytes() and friends still refer to
+  // contiguous memory.
+  explicit PickleIterator(const ChainedPickle& pickle);
 
   // Methods for reading the payload of the Pickle. To read from the start of
   // the Pickle, create a PickleIterator from a Pickle. If successful, these
@@ -59,6 +136,38 @@ class  PickleIterator {
     return ReadInt(result) && *result >= 0;
   }
 
+  // Read LEB128 varints written by Pickle::WriteVar*(). The signed variants
+  // undo the zigzag encoding. Values that do not fit |*result| fail.
+  bool ReadVarInt32(int32_t* result);
+  bool ReadVarInt64(int64_t* result);
+  bool ReadVarUInt32(uint32_t* result);
+  bool ReadVarUInt64(uint64_t* result);
+
+  // Reads an attachment index and looks it up in the pickle's attachment
+  // table. Fails when reading a ChainedPickle, which has no such table.
+  bool ReadAttachment(scoped_refptr<PickleAttachment>* result);
+
+  // Reads a buffer written with Pickle::WriteBuffer(). |*result| refers to the
+  // buffer that was attached; no bytes are copied.
+  bool ReadBuffer(scoped_refptr<PickleBufferAttachment>* result);
+
+  // Reads an array written with Pickle::WriteArray() in place: |*data| points
+  // into the message's buffer, with the same lifetime caveats as ReadData().
+  // The elements are aligned for T as long as the pickle's buffer is, which
+  // holds for every Pickle that owns its buffer, heap- or arena-backed; a
+  // read-only view of a misaligned buffer fails rather than hand out a
+  // misaligned pointer.
+  template <typename T>
+  bool ReadSpan(const T** data, int* count) {
+    static_assert(std::is_pod<T>::value, "ReadSpan() requires a POD type");
+    const char* read_from =
+        GetArrayPointerAndAdvance(count, sizeof(T), ALIGNOF(T));
+    if (!read_from)
+      return false;
+    *data = reinterpret_cast<const T*>(read_from);
+    return true;
+  }
+
   // Skips bytes in the read buffer and returns true if there are at least
   // num_bytes available. Otherwise, does nothing and returns false.
   bool SkipBytes(int num_bytes)  {
@@ -87,10 +196,29 @@ class  PickleIterator {
   const char* GetReadPointerAndAdvance(int num_elements,
                                        size_t size_element);
 
+  // Moves on to the next segment of a ChainedPickle once the current one is
+  // used up. Returns true if the new segment holds at least |num_bytes|.
+  bool NextSegment(size_t num_bytes);
+
+  // Reads the element count of an array, skips the padding that aligns its
+  // elements and returns a pointer to them.
+  const char* GetArrayPointerAndAdvance(int* count,
+                                        size_t element_size,
+                                        size_t element_alignment);
+
+  const Pickle* pickle_;  // Owner of the attachment table, if any.
   const char* payload_;  // Start of our pickle's payload.
   size_t read_index_;  // Offset of the next readable byte in payload.
   size_t end_index_;  // Payload size.
-
+  size_t alignment_;  // Padding granularity of fields.
+  // Offset of |payload_| from the start of the pickle, header included.
+  size_t payload_offset_;
+  // Segments of a ChainedPickle not yet loaded into |payload_|. Both are NULL
+  // when reading a contiguous Pickle.
+  const struct iovec* next_segment_;
+  const struct iovec* end_segment_;
+
+  friend class internal::PickleSchemaAccess;
   //FRIEND_TEST_ALL_PREFIXES(PickleTest, GetReadPointerAndAdvance);
 };
 
@@ -100,12 +228,19 @@ class  PickleIterator {
 class  PickleSizer {
  public:
   PickleSizer();
+  explicit PickleSizer(PickleFormat format);
+  // Sizes a pickle created with Pickle(int header_size).
+  explicit PickleSizer(int header_size);
   ~PickleSizer();
 
   // Returns the computed size of the payload.
   size_t payload_size() const { return payload_size_; }
 
-  void AddBool() { return AddInt(); }
+  void AddBool() {
+    if (alignment_ == 1)
+      return AddVarUInt32(1);
+    return AddInt();
+  }
   void AddInt() { AddPOD<int>(); }
   void AddLong() { AddPOD<uint64_t>(); }
   void AddUInt16() { return AddPOD<uint16_t>(); }
@@ -117,40 +252,62 @@ class  PickleSizer {
   void AddString(const StringPiece& value);
   void AddData(int length);
   void AddBytes(int length);
+  void AddVarInt32(int32_t value);
+  void AddVarInt64(int64_t value);
+  void AddVarUInt32(uint32_t value) { AddVarUInt64(value); }
+  void AddVarUInt64(uint64_t value);
+  void AddAttachment() { AddUInt32(); }
+  void AddBuffer() {
+    AddAttachment();
+    AddUInt32();
+  }
+  // The padding before the elements depends on the header size, so size a
+  // pickle with a custom header with PickleSizer(int header_size).
+  template <typename T>
+  void AddArray(int count) {
+    AddArrayCommon(count, sizeof(T), ALIGNOF(T));
+  }
 
  private:
   // Just like AddBytes() but with a compile-time size for performance.
   template<size_t length> void  AddBytesStatic();
 
+  void AddArrayCommon(int count, size_t element_size, size_t element_alignment);
+
   template <typename T>
   void AddPOD() { AddBytesStatic<sizeof(T)>(); }
 
   size_t payload_size_ = 0;
+  const size_t header_size_;
+  const size_t alignment_;
 };
 
 class  Pickle {
  public:
-  class  Attachment : public RefCountedThreadSafe<Attachment> {
-   public:
-    Attachment();
-
-   protected:
-    friend class RefCountedThreadSafe<Attachment>;
-    virtual ~Attachment();
-
-    DISALLOW_COPY_AND_ASSIGN(Attachment);
-  };
+  typedef PickleAttachment Attachment;
+  typedef PickleBufferAttachment BufferAttachment;
 
   Pickle();
   explicit Pickle(int header_size);
+  // Allocates the buffer from |arena| instead of the heap, so all pickles of
+  // a request are released together by the arena's Reset(). Growth reuses
+  // the arena's in-place realloc of its last allocation. The pickle must not
+  // be used after the arena is Reset(). Copies of it are heap-backed.
+  explicit Pickle(BaseArena* arena);
+  // Creates an empty pickle in |format|.
+  explicit Pickle(PickleFormat format);
   Pickle(const char* data, int data_len);
   Pickle(const Pickle& other);
   virtual ~Pickle();
   Pickle& operator=(const Pickle& other);
-  size_t size() const { return header_size_ + header_->payload_size; }
+  size_t size() const { return header_size_ + payload_size(); }
   const void* data() const { return header_; }
   size_t GetTotalAllocatedSize() const;
+  // A compact pickle writes a bool as a one-byte varint, an aligned one as
+  // an int.
   bool WriteBool(bool value) {
+    if (alignment_ == 1)
+      return WriteVarUInt32(value ? 1 : 0);
     return WriteInt(value ? 1 : 0);
   }
   bool WriteInt(int value) {
@@ -175,6 +332,45 @@ class  Pickle {
   bool WriteData(const char* data, int length);
   bool WriteBytes(const void* data, int length);
 
+  // Write integers as LEB128 varints of one to ten bytes. The signed variants
+  // zigzag-encode first so that small negative values stay short. Best used
+  // with a PICKLE_COMPACT pickle; an aligned one still pads them.
+  bool WriteVarInt32(int32_t value);
+  bool WriteVarInt64(int64_t value);
+  bool WriteVarUInt32(uint32_t value) { return WriteVarUInt64(value); }
+  bool WriteVarUInt64(uint64_t value);
+
+  // Write |count| POD elements in one go: the count as an int, then padding
+  // that aligns the elements for T relative to the start of the pickle, then
+  // the elements themselves. Read them back with PickleIterator::ReadSpan().
+  template <typename T>
+  bool WriteArray(const T* values, int count) {
+    static_assert(std::is_pod<T>::value, "WriteArray() requires a POD type");
+    return WriteArrayCommon(values, count, sizeof(T), ALIGNOF(T));
+  }
+  bool WriteInt32Array(const int32_t* values, int count) {
+    return WriteArray(values, count);
+  }
+  bool WriteUInt32Array(const uint32_t* values, int count) {
+    return WriteArray(values, count);
+  }
+  bool WriteInt64Array(const int64_t* values, int count) {
+    return WriteArray(values, count);
+  }
+  bool WriteUInt64Array(const uint64_t* values, int count) {
+    return WriteArray(values, count);
+  }
+  bool WriteFloatArray(const float* values, int count) {
+    return WriteArray(values, count);
+  }
+  bool WriteDoubleArray(const double* values, int count) {
+    return WriteArray(values, count);
+  }
+
+  PickleFormat format() const {
+    return alignment_ == 1 ? PICKLE_COMPACT : PICKLE_ALIGNED;
+  }
+
   // WriteAttachment appends |attachment| to the pickle. It returns
   // false iff the set is full or if the Pickle implementation does not support
   // attachments.
@@ -188,6 +384,25 @@ class  Pickle {
   // Indicates whether the pickle has any attachments.
   virtual bool HasAttachments() const;
 
+  // Attaches |buffer| by reference. Only its index in the attachment table
+  // and its length are written to the payload.
+  bool WriteBuffer(scoped_refptr<BufferAttachment> buffer);
+
+  // Reads a buffer written with WriteBuffer(), checking that the recorded
+  // length matches the attached buffer.
+  bool ReadBuffer(PickleIterator* iter,
+                  scoped_refptr<BufferAttachment>* buffer) const;
+
+  // The attachment table, in index order. A transport sends these alongside
+  // the pickle's bytes and hands them to the receiving Pickle, which is
+  // usually a read-only view, with AdoptAttachments().
+  const std::vector<scoped_refptr<Attachment> >& attachments() const {
+    return attachments_;
+  }
+  void AdoptAttachments(std::vector<scoped_refptr<Attachment> >* attachments) {
+    attachments_.swap(*attachments);
+  }
+
   // Reserves space for upcoming writes when multiple writes will be made and
   // their sizes are computed in advance. It can be significantly faster to call
   // Reserve() before calling WriteFoo() multiple times.
@@ -195,9 +410,13 @@ class  Pickle {
 
   // Payload follows after allocation of Header (header size is customizable).
   struct Header {
-    uint32_t payload_size;  // Specifies the size of the payload.
+    // Specifies the size of the payload. The top bit is kCompactFlag.
+    uint32_t payload_size;
   };
 
+  // Set in Header::payload_size for PICKLE_COMPACT pickles.
+  static const uint32_t kCompactFlag = 0x80000000u;
+
   // Returns the header, cast to a user-specified type T.  The type T must be a
   // subclass of Header and its size must correspond to the header_size passed
   // to the Pickle constructor.
@@ -214,7 +433,7 @@ class  Pickle {
 
   // The payload is the pickle data immediately following the header.
   size_t payload_size() const {
-    return header_ ? header_->payload_size : 0;
+    return header_ ? header_->payload_size & ~kCompactFlag : 0;
   }
 
   const char* payload() const {
@@ -271,6 +490,8 @@ class  Pickle {
 
  private:
   friend class PickleIterator;
+  friend class PickleFrameReader;
+  friend class internal::PickleSchemaAccess;
 
   Header* header_;
   size_t header_size_;  // Supports extra data between header and payload.
@@ -280,6 +501,11 @@ class  Pickle {
   // The offset at which we will write the next field. Note: this doesn't count
   // the header.
   size_t write_offset_;
+  // Arena the buffer comes from, or NULL for the heap.
+  BaseArena* arena_;
+  // Padding granularity of fields: sizeof(uint32_t), or 1 when compact.
+  size_t alignment_;
+  std::vector<scoped_refptr<Attachment> > attachments_;
 
   // Just like WriteBytes, but with a compile-time size, for performance.
   template<size_t length> void  WriteBytesStatic(const void* data);
@@ -290,8 +516,15 @@ class  Pickle {
     return true;
   }
 
+  // Releases the buffer to the heap or arena it came from.
+  void FreeBuffer();
+
   inline void* ClaimUninitializedBytesInternal(size_t num_bytes);
   inline void WriteBytesCommon(const void* data, size_t length);
+  bool WriteArrayCommon(const void* data,
+                        int count,
+                        size_t element_size,
+                        size_t element_alignment);
 };
 
 }  // namespace base
@@ -0,0 +1,80 @@
+#include "base/pickle.h"
+#include <gtest/gtest.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+#include "base/arena.h"
+
+using namespace mrpc;
+
+namespace {
+
+const std::string teststring("Hello world");
+const double testdouble = 2.71828182845904523;
+
+} // namespace
+
+TEST(PickleArenaTest, ArenaBacked) {
+  UnsafeArena arena(4096);
+  {
+    Pickle pickle(&arena);
+    for (int i = 0; i < 1000; ++i)
+      EXPECT_TRUE(pickle.WriteInt(i));
+    EXPECT_TRUE(pickle.WriteString(teststring));
+    EXPECT_EQ(0u,
+              reinterpret_cast<uintptr_t>(pickle.data()) %
+                  ALIGNOF(max_align_t));
+
+    PickleIterator iter(pickle);
+    for (int i = 0; i < 1000; ++i) {
+      int outint;
+      EXPECT_TRUE(iter.ReadInt(&outint));
+      EXPECT_EQ(i, outint);
+    }
+    std::string outstring;
+    EXPECT_TRUE(iter.ReadString(&outstring));
+    EXPECT_EQ(teststring, outstring);
+
+    // Copies live on the heap and survive the arena.
+    Pickle copy(pickle);
+    EXPECT_EQ(pickle.size(), copy.size());
+    EXPECT_EQ(0, memcmp(pickle.data(), copy.data(), pickle.size()));
+  }
+  arena.Reset();
+  EXPECT_TRUE(arena.is_empty());
+}
+
+TEST(PickleArenaTest, ArenaBackedGrowsInPlace) {
+  UnsafeArena arena(64 * 1024);
+  Pickle pickle(&arena);
+  const void* start = pickle.data();
+  for (int i = 0; i < 1000; ++i)
+    EXPECT_TRUE(pickle.WriteInt(i));
+  // The pickle is the arena's last allocation, so it never moved.
+  EXPECT_EQ(start, pickle.data());
+}
+
+TEST(PickleArenaTest, ArenaBackedArrays) {
+  UnsafeArena arena(4096);
+  // Leaves the arena's free pointer four bytes off an eight-byte boundary.
+  arena.Alloc(4);
+  const double doubles[] = { testdouble, -testdouble, 0.0 };
+
+  Pickle pickle(&arena);
+  EXPECT_TRUE(pickle.WriteInt(1));
+  EXPECT_TRUE(pickle.WriteArray(doubles, static_cast<int>(ARRAYSIZE(doubles))));
+
+  PickleIterator iter(pickle);
+  int outint;
+  EXPECT_TRUE(iter.ReadInt(&outint));
+  const double* outdoubles;
+  int count;
+  EXPECT_TRUE(iter.ReadSpan(&outdoubles, &count));
+  ASSERT_EQ(static_cast<int>(ARRAYSIZE(doubles)), count);
+  for (int i = 0; i < count; ++i)
+    EXPECT_EQ(doubles[i], outdoubles[i]);
+}
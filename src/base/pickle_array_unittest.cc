@@ -0,0 +1,140 @@
+#include "base/pickle.h"
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "base/chained_pickle.h"
+
+using namespace mrpc;
+
+namespace {
+
+const int testint = 2093847192;
+const double testdouble = 2.71828182845904523;
+
+} // namespace
+
+TEST(PickleArrayTest, Arrays) {
+  std::vector<int32_t> ints(100000);
+  for (size_t i = 0; i < ints.size(); ++i)
+    ints[i] = static_cast<int32_t>(i) - 5000;
+  const double doubles[] = { testdouble, -testdouble, 0.0 };
+
+  Pickle pickle;
+  PickleSizer sizer;
+  EXPECT_TRUE(pickle.WriteInt32Array(&ints[0], static_cast<int>(ints.size())));
+  sizer.AddArray<int32_t>(static_cast<int>(ints.size()));
+  // Leaves the doubles four bytes off an eight-byte boundary without padding.
+  EXPECT_TRUE(pickle.WriteInt(testint));
+  sizer.AddInt();
+  EXPECT_TRUE(pickle.WriteDoubleArray(doubles, static_cast<int>(ARRAYSIZE(doubles))));
+  sizer.AddArray<double>(static_cast<int>(ARRAYSIZE(doubles)));
+  EXPECT_TRUE(pickle.WriteInt64Array(NULL, 0));
+  sizer.AddArray<int64_t>(0);
+  EXPECT_EQ(sizer.payload_size(), pickle.payload_size());
+
+  PickleIterator iter(pickle);
+  const int32_t* outints;
+  int count;
+  EXPECT_TRUE(iter.ReadSpan(&outints, &count));
+  ASSERT_EQ(static_cast<int>(ints.size()), count);
+  EXPECT_EQ(0, memcmp(&ints[0], outints, ints.size() * sizeof(int32_t)));
+
+  int outint;
+  EXPECT_TRUE(iter.ReadInt(&outint));
+  EXPECT_EQ(testint, outint);
+
+  const double* outdoubles;
+  EXPECT_TRUE(iter.ReadSpan(&outdoubles, &count));
+  ASSERT_EQ(static_cast<int>(static_cast<int>(ARRAYSIZE(doubles))), count);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(outdoubles) % ALIGNOF(double));
+  for (int i = 0; i < count; ++i)
+    EXPECT_EQ(doubles[i], outdoubles[i]);
+
+  const int64_t* outint64s;
+  EXPECT_TRUE(iter.ReadSpan(&outint64s, &count));
+  EXPECT_EQ(0, count);
+  EXPECT_FALSE(iter.ReadInt(&outint));
+}
+
+TEST(PickleArrayTest, BadArrayLength) {
+  Pickle pickle;
+  EXPECT_FALSE(pickle.WriteInt32Array(NULL, -1));
+  EXPECT_TRUE(pickle.WriteInt(1000));
+  EXPECT_TRUE(pickle.WriteInt(1));
+
+  PickleIterator iter(pickle);
+  const int32_t* outints;
+  int count;
+  EXPECT_FALSE(iter.ReadSpan(&outints, &count));
+}
+
+TEST(PickleArrayTest, CustomHeaderSize) {
+  const double doubles[] = { testdouble, -testdouble };
+  Pickle pickle(8);
+  EXPECT_TRUE(pickle.WriteInt(testint));
+  EXPECT_TRUE(pickle.WriteArray(doubles, static_cast<int>(ARRAYSIZE(doubles))));
+
+  // The padding before the doubles depends on the header size.
+  PickleSizer sizer(8);
+  sizer.AddInt();
+  sizer.AddArray<double>(static_cast<int>(ARRAYSIZE(doubles)));
+  EXPECT_EQ(sizer.payload_size(), pickle.payload_size());
+  PickleSizer default_sizer;
+  default_sizer.AddInt();
+  default_sizer.AddArray<double>(static_cast<int>(ARRAYSIZE(doubles)));
+  EXPECT_NE(default_sizer.payload_size(), pickle.payload_size());
+
+  PickleIterator iter(pickle);
+  int outint;
+  EXPECT_TRUE(iter.ReadInt(&outint));
+  const double* outdoubles;
+  int count;
+  EXPECT_TRUE(iter.ReadSpan(&outdoubles, &count));
+  ASSERT_EQ(static_cast<int>(ARRAYSIZE(doubles)), count);
+  EXPECT_EQ(0, memcmp(doubles, outdoubles, sizeof(doubles)));
+}
+
+TEST(PickleArrayTest, ChainedSpan) {
+  // ChainedPickle has no array writer, so lay out by hand what
+  // Pickle::WriteArray() would: the second segment starts sixteen bytes into
+  // the pickle and holds an int, the count and one double at offset 24.
+  ChainedPickle chained(16);
+  EXPECT_TRUE(chained.WriteInt(1));
+  EXPECT_TRUE(chained.WriteInt(2));
+  EXPECT_TRUE(chained.WriteInt(3));
+  EXPECT_TRUE(chained.WriteInt(testint));
+  EXPECT_TRUE(chained.WriteInt(1));
+  EXPECT_TRUE(chained.WriteDouble(testdouble));
+  ASSERT_EQ(2, chained.segment_count());
+
+  Pickle pickle;
+  EXPECT_TRUE(pickle.WriteInt(1));
+  EXPECT_TRUE(pickle.WriteInt(2));
+  EXPECT_TRUE(pickle.WriteInt(3));
+  EXPECT_TRUE(pickle.WriteInt(testint));
+  EXPECT_TRUE(pickle.WriteArray(&testdouble, 1));
+  std::string flat;
+  chained.Flatten(&flat);
+  ASSERT_EQ(pickle.size(), flat.size());
+  EXPECT_EQ(0, memcmp(pickle.data(), flat.data(), flat.size()));
+
+  PickleIterator iter(chained);
+  int outint;
+  for (int i = 1; i <= 3; ++i) {
+    EXPECT_TRUE(iter.ReadInt(&outint));
+    EXPECT_EQ(i, outint);
+  }
+  EXPECT_TRUE(iter.ReadInt(&outint));
+  EXPECT_EQ(testint, outint);
+  const double* outdoubles;
+  int count;
+  EXPECT_TRUE(iter.ReadSpan(&outdoubles, &count));
+  ASSERT_EQ(1, count);
+  EXPECT_EQ(testdouble, outdoubles[0]);
+  EXPECT_FALSE(iter.ReadInt(&outint));
+}
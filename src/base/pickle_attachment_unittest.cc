@@ -0,0 +1,85 @@
+#include "base/pickle.h"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+using namespace mrpc;
+
+namespace {
+
+const int testint = 2093847192;
+
+} // namespace
+
+TEST(PickleAttachmentTest, Attachments) {
+  Pickle pickle;
+  EXPECT_FALSE(pickle.HasAttachments());
+
+  std::string blob(100000, 'x');
+  scoped_refptr<PickleBufferAttachment> buffer(
+      new PickleBufferAttachment(&blob));
+  EXPECT_TRUE(blob.empty());
+  const char* original = buffer->data();
+
+  EXPECT_TRUE(pickle.WriteInt(testint));
+  EXPECT_TRUE(pickle.WriteBuffer(buffer));
+  EXPECT_TRUE(pickle.WriteInt(testint));
+  EXPECT_TRUE(pickle.HasAttachments());
+  EXPECT_EQ(1u, pickle.attachments().size());
+
+  // Only the index and the length go inline.
+  PickleSizer sizer;
+  sizer.AddInt();
+  sizer.AddBuffer();
+  sizer.AddInt();
+  EXPECT_EQ(sizer.payload_size(), pickle.payload_size());
+
+  PickleIterator iter(pickle);
+  int outint;
+  EXPECT_TRUE(iter.ReadInt(&outint));
+  scoped_refptr<PickleBufferAttachment> outbuffer;
+  EXPECT_TRUE(iter.ReadBuffer(&outbuffer));
+  EXPECT_EQ(original, outbuffer->data());
+  EXPECT_EQ(100000u, outbuffer->size());
+  EXPECT_TRUE(iter.ReadInt(&outint));
+  EXPECT_EQ(testint, outint);
+}
+
+TEST(PickleAttachmentTest, AdoptAttachments) {
+  Pickle pickle;
+  std::string blob("Hello world");
+  EXPECT_TRUE(pickle.WriteBuffer(new PickleBufferAttachment(&blob)));
+
+  // Ship the bytes and the attachment table separately.
+  std::vector<scoped_refptr<Pickle::Attachment> > attachments(
+      pickle.attachments());
+  Pickle view(static_cast<const char*>(pickle.data()),
+              static_cast<int>(pickle.size()));
+  PickleIterator no_table(view);
+  scoped_refptr<PickleBufferAttachment> outbuffer;
+  EXPECT_FALSE(no_table.ReadBuffer(&outbuffer));
+
+  view.AdoptAttachments(&attachments);
+  PickleIterator iter(view);
+  EXPECT_TRUE(iter.ReadBuffer(&outbuffer));
+  EXPECT_EQ("Hello world", std::string(outbuffer->data(), outbuffer->size()));
+}
+
+TEST(PickleAttachmentTest, BadAttachmentIndex) {
+  Pickle pickle;
+  EXPECT_TRUE(pickle.WriteUInt32(0));
+  EXPECT_TRUE(pickle.WriteUInt32(0));
+
+  PickleIterator iter(pickle);
+  scoped_refptr<Pickle::Attachment> attachment;
+  EXPECT_FALSE(iter.ReadAttachment(&attachment));
+
+  // An opaque attachment cannot be read back as a buffer.
+  Pickle opaque;
+  EXPECT_TRUE(opaque.WriteAttachment(new Pickle::Attachment));
+  EXPECT_TRUE(opaque.WriteUInt32(0));
+  PickleIterator opaque_iter(opaque);
+  scoped_refptr<PickleBufferAttachment> buffer;
+  EXPECT_FALSE(opaque_iter.ReadBuffer(&buffer));
+}
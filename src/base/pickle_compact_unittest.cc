@@ -0,0 +1,138 @@
+#include "base/pickle.h"
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+
+#include <limits>
+#include <string>
+
+using namespace mrpc;
+
+namespace {
+
+const int testint = 2093847192;
+const int64_t testint64 = -0x7E8CA9253104BDFCLL;
+const std::string teststring("Hello world");
+
+} // namespace
+
+TEST(PickleCompactTest, VarInts) {
+  const int64_t values[] = {
+    0, 1, -1, 63, -64, 64, 127, 128, 300, -300, testint, -testint,
+    std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::min(),
+    testint64, std::numeric_limits<int64_t>::max(),
+    std::numeric_limits<int64_t>::min(),
+  };
+  const PickleFormat formats[] = { PICKLE_ALIGNED, PICKLE_COMPACT };
+  for (size_t f = 0; f < ARRAYSIZE(formats); ++f) {
+    Pickle pickle(formats[f]);
+    PickleSizer sizer(formats[f]);
+    EXPECT_EQ(formats[f], pickle.format());
+    for (size_t i = 0; i < ARRAYSIZE(values); ++i) {
+      EXPECT_TRUE(pickle.WriteVarInt64(values[i]));
+      sizer.AddVarInt64(values[i]);
+      EXPECT_TRUE(pickle.WriteVarUInt64(static_cast<uint64_t>(values[i])));
+      sizer.AddVarUInt64(static_cast<uint64_t>(values[i]));
+      if (values[i] >= std::numeric_limits<int32_t>::min() &&
+          values[i] <= std::numeric_limits<int32_t>::max()) {
+        EXPECT_TRUE(pickle.WriteVarInt32(static_cast<int32_t>(values[i])));
+        sizer.AddVarInt32(static_cast<int32_t>(values[i]));
+      }
+    }
+    EXPECT_EQ(sizer.payload_size(), pickle.payload_size());
+
+    PickleIterator iter(pickle);
+    for (size_t i = 0; i < ARRAYSIZE(values); ++i) {
+      int64_t outint64;
+      EXPECT_TRUE(iter.ReadVarInt64(&outint64));
+      EXPECT_EQ(values[i], outint64);
+      uint64_t outuint64;
+      EXPECT_TRUE(iter.ReadVarUInt64(&outuint64));
+      EXPECT_EQ(static_cast<uint64_t>(values[i]), outuint64);
+      if (values[i] >= std::numeric_limits<int32_t>::min() &&
+          values[i] <= std::numeric_limits<int32_t>::max()) {
+        int32_t outint32;
+        EXPECT_TRUE(iter.ReadVarInt32(&outint32));
+        EXPECT_EQ(values[i], outint32);
+      }
+    }
+    int64_t outint64;
+    EXPECT_FALSE(iter.ReadVarInt64(&outint64));
+  }
+}
+
+TEST(PickleCompactTest, CompactFormat) {
+  Pickle pickle(PICKLE_COMPACT);
+  EXPECT_TRUE(pickle.WriteVarInt32(-1));
+  EXPECT_TRUE(pickle.WriteBool(true));
+  EXPECT_TRUE(pickle.WriteString(teststring));
+  EXPECT_TRUE(pickle.WriteVarUInt32(300));
+  // 1 + 1 + (4 + 11) + 2 bytes, with no padding.
+  EXPECT_EQ(19u, pickle.payload_size());
+
+  PickleSizer sizer(PICKLE_COMPACT);
+  sizer.AddVarInt32(-1);
+  sizer.AddBool();
+  sizer.AddString(teststring);
+  sizer.AddVarUInt32(300);
+  EXPECT_EQ(pickle.payload_size(), sizer.payload_size());
+
+  // The format travels in the header.
+  Pickle view(static_cast<const char*>(pickle.data()),
+              static_cast<int>(pickle.size()));
+  EXPECT_EQ(PICKLE_COMPACT, view.format());
+  EXPECT_EQ(19u, view.payload_size());
+  EXPECT_EQ(pickle.size(), view.size());
+
+  PickleIterator iter(view);
+  int32_t outint32;
+  EXPECT_TRUE(iter.ReadVarInt32(&outint32));
+  EXPECT_EQ(-1, outint32);
+  bool outbool;
+  EXPECT_TRUE(iter.ReadBool(&outbool));
+  EXPECT_TRUE(outbool);
+  std::string outstring;
+  EXPECT_TRUE(iter.ReadString(&outstring));
+  EXPECT_EQ(teststring, outstring);
+  uint32_t outuint32;
+  EXPECT_TRUE(iter.ReadVarUInt32(&outuint32));
+  EXPECT_EQ(300u, outuint32);
+
+  Pickle copy(view);
+  EXPECT_EQ(PICKLE_COMPACT, copy.format());
+}
+
+TEST(PickleCompactTest, BadVarInt) {
+  Pickle pickle(PICKLE_COMPACT);
+  const char unterminated[] = "\xff\xff";
+  EXPECT_TRUE(pickle.WriteBytes(unterminated, 2));
+
+  PickleIterator iter(pickle);
+  uint64_t outuint64;
+  EXPECT_FALSE(iter.ReadVarUInt64(&outuint64));
+
+  // Ten bytes reach bit 63; a tenth byte with more bits set overflows, and
+  // one with the continuation bit set is overlong.
+  const char overflow[] = "\xff\xff\xff\xff\xff\xff\xff\xff\xff\x02";
+  const char overlong[] =
+      "\x80\x80\x80\x80\x80\x80\x80\x80\x80\x81\x00";
+  const char max[] = "\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01";
+  Pickle edges(PICKLE_COMPACT);
+  EXPECT_TRUE(edges.WriteBytes(max, 10));
+  EXPECT_TRUE(edges.WriteBytes(overflow, 10));
+  PickleIterator edges_iter(edges);
+  EXPECT_TRUE(edges_iter.ReadVarUInt64(&outuint64));
+  EXPECT_EQ(std::numeric_limits<uint64_t>::max(), outuint64);
+  EXPECT_FALSE(edges_iter.ReadVarUInt64(&outuint64));
+
+  Pickle overlong_pickle(PICKLE_COMPACT);
+  EXPECT_TRUE(overlong_pickle.WriteBytes(overlong, 11));
+  PickleIterator overlong_iter(overlong_pickle);
+  EXPECT_FALSE(overlong_iter.ReadVarUInt64(&outuint64));
+
+  Pickle too_big(PICKLE_COMPACT);
+  EXPECT_TRUE(too_big.WriteVarUInt64(1ULL << 32));
+  PickleIterator too_big_iter(too_big);
+  uint32_t outuint32;
+  EXPECT_FALSE(too_big_iter.ReadVarUInt32(&outuint32));
+}
@@ -0,0 +1,105 @@
+#include "base/pickle_frame_reader.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "base/bits.h"
+
+namespace mrpc {
+
+PickleFrameReader::PickleFrameReader(size_t header_size,
+                                     size_t max_frame_size,
+                                     Delegate* delegate)
+    : header_size_(header_size),
+      max_frame_size_(max_frame_size),
+      delegate_(delegate),
+      pending_frame_size_(0),
+      failed_(false) {
+  CHECK_EQ(header_size_, bits::Align(header_size_, sizeof(uint32_t)));
+  CHECK_GE(header_size_, sizeof(Pickle::Header));
+  CHECK_LE(header_size_, static_cast<size_t>(Pickle::kPayloadUnit));
+  // Frames are handed out through Pickle(const char*, int).
+  CHECK_LE(max_frame_size_,
+           static_cast<size_t>(std::numeric_limits<int>::max()));
+  CHECK(delegate_);
+}
+
+PickleFrameReader::~PickleFrameReader() {}
+
+bool PickleFrameReader::Consume(const char* data, size_t size) {
+  if (failed_)
+    return false;
+
+  // Finish the frame left over from earlier chunks first.
+  if (!pending_.empty()) {
+    if (!pending_frame_size_) {
+      size_t needed = header_size_ - pending_.size();
+      size_t taken = std::min(needed, size);
+      pending_.append(data, taken);
+      data += taken;
+      size -= taken;
+      if (pending_.size() < header_size_)
+        return true;
+      if (!PeekFrameSize(pending_.data(), pending_.size(),
+                         &pending_frame_size_))
+        return false;
+      pending_.reserve(pending_frame_size_);
+    }
+    size_t taken = std::min(pending_frame_size_ - pending_.size(), size);
+    pending_.append(data, taken);
+    data += taken;
+    size -= taken;
+    if (pending_.size() < pending_frame_size_)
+      return true;
+    if (!DispatchFrame(pending_.data(), pending_frame_size_))
+      return false;
+    pending_.clear();
+    pending_frame_size_ = 0;
+  }
+
+  // Hand out frames that lie wholly inside this chunk without copying.
+  while (size >= header_size_) {
+    size_t frame_size;
+    if (!PeekFrameSize(data, size, &frame_size))
+      return false;
+    if (frame_size > size)
+      break;
+    if (!DispatchFrame(data, frame_size))
+      return false;
+    data += frame_size;
+    size -= frame_size;
+  }
+
+  if (size) {
+    pending_.assign(data, size);
+    if (size >= header_size_) {
+      // The frame is known to be valid-sized from the loop above.
+      PeekFrameSize(data, size, &pending_frame_size_);
+      pending_.reserve(pending_frame_size_);
+    }
+  }
+  return true;
+}
+
+bool PickleFrameReader::PeekFrameSize(const char* data,
+                                      size_t size,
+                                      size_t* frame_size) {
+  if (!Pickle::PeekNext(header_size_, data, data + size, frame_size) ||
+      *frame_size > max_frame_size_) {
+    failed_ = true;
+    return false;
+  }
+  return true;
+}
+
+bool PickleFrameReader::DispatchFrame(const char* data, size_t frame_size) {
+  Pickle frame(data, static_cast<int>(frame_size));
+  if (!frame.data()) {
+    failed_ = true;
+    return false;
+  }
+  delegate_->OnFrame(frame);
+  return true;
+}
+
+} // namespace mrpc
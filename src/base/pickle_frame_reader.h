@@ -0,0 +1,71 @@
+#ifndef MRPC_BASE_PICKLE_FRAME_READER_H_
+#define MRPC_BASE_PICKLE_FRAME_READER_H_
+
+#include <stddef.h>
+
+#include <string>
+
+#include "base/macros.h"
+#include "base/pickle.h"
+
+namespace mrpc {
+
+// Splits a byte stream of back-to-back pickles into frames. Feed it whatever
+// each socket read returns; it hands every complete frame to its delegate as
+// a read-only Pickle view.
+//
+// A frame that lies wholly inside one chunk is not copied: the view points
+// straight into the caller's buffer. Only frames split across reads are
+// gathered into an internal buffer, which is sized from the frame header so
+// it is filled without reallocation.
+class PickleFrameReader {
+ public:
+  class Delegate {
+   public:
+    virtual ~Delegate() {}
+
+    // |frame| and its payload are only valid during the call.
+    virtual void OnFrame(const Pickle& frame) = 0;
+  };
+
+  // |header_size| is the size of the pickles' header, as passed to
+  // Pickle(int header_size). Frames larger than |max_frame_size| bytes,
+  // header included, are rejected.
+  PickleFrameReader(size_t header_size,
+                    size_t max_frame_size,
+                    Delegate* delegate);
+  ~PickleFrameReader();
+
+  // Consumes |size| bytes of the stream, calling the delegate for each frame
+  // completed by them. Returns false if a frame is malformed or exceeds the
+  // maximum size; the stream cannot be resynchronized after that and every
+  // later call fails as well.
+  bool Consume(const char* data, size_t size);
+
+  // Bytes of an incomplete frame held from previous calls.
+  size_t pending_bytes() const { return pending_.size(); }
+  bool failed() const { return failed_; }
+
+ private:
+  // Reads the size of the frame whose header starts at |data|. Returns false
+  // and marks the reader failed if the frame is too large.
+  bool PeekFrameSize(const char* data, size_t size, size_t* frame_size);
+
+  // Hands the frame at |data| to the delegate. Returns false and marks the
+  // reader failed if it is not a valid pickle.
+  bool DispatchFrame(const char* data, size_t frame_size);
+
+  const size_t header_size_;
+  const size_t max_frame_size_;
+  Delegate* delegate_;
+  // Start of a frame that did not fit in the chunk it began in.
+  std::string pending_;
+  // Total size of the pending frame, or 0 while its header is incomplete.
+  size_t pending_frame_size_;
+  bool failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(PickleFrameReader);
+};
+
+} // namespace mrpc
+#endif // MRPC_BASE_PICKLE_FRAME_READER_H_
@@ -0,0 +1,120 @@
+#include "base/pickle_frame_reader.h"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+using namespace mrpc;
+
+namespace {
+
+class FrameCollector : public PickleFrameReader::Delegate {
+ public:
+  void OnFrame(const Pickle& frame) override {
+    PickleIterator iter(frame);
+    std::string value;
+    EXPECT_TRUE(iter.ReadString(&value));
+    values_.push_back(value);
+    frame_data_.push_back(static_cast<const char*>(frame.data()));
+  }
+
+  const std::vector<std::string>& values() const { return values_; }
+  const std::vector<const char*>& frame_data() const { return frame_data_; }
+
+ private:
+  std::vector<std::string> values_;
+  std::vector<const char*> frame_data_;
+};
+
+std::string MakeStream(const std::vector<std::string>& values) {
+  std::string stream;
+  for (size_t i = 0; i < values.size(); ++i) {
+    Pickle pickle;
+    pickle.WriteString(values[i]);
+    stream.append(static_cast<const char*>(pickle.data()), pickle.size());
+  }
+  return stream;
+}
+
+std::vector<std::string> TestValues() {
+  std::vector<std::string> values;
+  values.push_back("Hello world");
+  values.push_back("");
+  values.push_back(std::string(1000, 'x'));
+  values.push_back("Goooooooooooogle");
+  return values;
+}
+
+}  // namespace
+
+TEST(PickleFrameReaderTest, WholeFramesAreNotCopied) {
+  std::vector<std::string> values = TestValues();
+  std::string stream = MakeStream(values);
+  FrameCollector collector;
+  PickleFrameReader reader(sizeof(Pickle::Header), 4096, &collector);
+
+  EXPECT_TRUE(reader.Consume(stream.data(), stream.size()));
+  EXPECT_EQ(values, collector.values());
+  EXPECT_EQ(0u, reader.pending_bytes());
+  ASSERT_FALSE(collector.frame_data().empty());
+  EXPECT_EQ(stream.data(), collector.frame_data()[0]);
+}
+
+TEST(PickleFrameReaderTest, SplitAtEveryChunkSize) {
+  std::vector<std::string> values = TestValues();
+  std::string stream = MakeStream(values);
+  for (size_t chunk = 1; chunk <= stream.size(); chunk += 3) {
+    FrameCollector collector;
+    PickleFrameReader reader(sizeof(Pickle::Header), 4096, &collector);
+    for (size_t offset = 0; offset < stream.size(); offset += chunk) {
+      size_t size = std::min(chunk, stream.size() - offset);
+      EXPECT_TRUE(reader.Consume(stream.data() + offset, size));
+    }
+    EXPECT_EQ(values, collector.values());
+    EXPECT_EQ(0u, reader.pending_bytes());
+  }
+}
+
+TEST(PickleFrameReaderTest, CustomHeader) {
+  struct CustomHeader : Pickle::Header {
+    int cookies[3];
+  };
+  std::string stream;
+  for (int i = 0; i < 3; ++i) {
+    Pickle pickle(sizeof(CustomHeader));
+    pickle.WriteString("cookie");
+    stream.append(static_cast<const char*>(pickle.data()), pickle.size());
+  }
+
+  FrameCollector collector;
+  PickleFrameReader reader(sizeof(CustomHeader), 4096, &collector);
+  EXPECT_TRUE(reader.Consume(stream.data(), 5));
+  EXPECT_TRUE(reader.Consume(stream.data() + 5, stream.size() - 5));
+  EXPECT_EQ(3u, collector.values().size());
+}
+
+TEST(PickleFrameReaderTest, MaxFrameSize) {
+  std::vector<std::string> values = TestValues();
+  std::string stream = MakeStream(values);
+  FrameCollector collector;
+  PickleFrameReader reader(sizeof(Pickle::Header), 100, &collector);
+
+  EXPECT_FALSE(reader.Consume(stream.data(), stream.size()));
+  EXPECT_TRUE(reader.failed());
+  // The frames before the oversized one were delivered.
+  EXPECT_EQ(2u, collector.values().size());
+  EXPECT_FALSE(reader.Consume(stream.data(), stream.size()));
+  EXPECT_EQ(2u, collector.values().size());
+}
+
+TEST(PickleFrameReaderTest, MaxFrameSizeInSplitHeader) {
+  Pickle pickle;
+  pickle.WriteString(std::string(1000, 'x'));
+  const char* data = static_cast<const char*>(pickle.data());
+
+  FrameCollector collector;
+  PickleFrameReader reader(sizeof(Pickle::Header), 100, &collector);
+  EXPECT_TRUE(reader.Consume(data, 2));
+  EXPECT_FALSE(reader.Consume(data + 2, 2));
+  EXPECT_TRUE(collector.values().empty());
+}
@@ -0,0 +1,305 @@
+#ifndef MRPC_BASE_PICKLE_SCHEMA_H_
+#define MRPC_BASE_PICKLE_SCHEMA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <type_traits>
+
+#include "base/pickle.h"
+
+namespace mrpc {
+
+// Describes how a message struct maps onto a Pickle, once, so that the
+// Write, Read and Size code is generated instead of hand-written three times:
+//
+//   struct EchoRequest {
+//     int32_t id;
+//     uint64_t deadline;
+//     std::string body;
+//   };
+//
+//   template <>
+//   struct PickleSchema<EchoRequest> {
+//     typedef PickleFields<MRPC_PICKLE_FIELD(EchoRequest, id),
+//                          MRPC_PICKLE_FIELD(EchoRequest, deadline),
+//                          MRPC_PICKLE_FIELD(EchoRequest, body)> Fields;
+//   };
+//
+//   WritePickleMessage(&pickle, request);
+//   ReadPickleMessage(&iter, &request);
+//   AddPickleMessage(&sizer, request);
+//
+// The wire format is exactly what the equivalent sequence of Write*() calls
+// produces. The leading run of fixed-size fields (|id| and |deadline| above)
+// is sized at compile time, claimed with a single ClaimBytes() and read back
+// after a single bounds check.
+template <typename Message>
+struct PickleSchema;
+
+// How one field type is written. kWireSize is the padded size of a fixed-size
+// field in an aligned pickle, or 0 for variable-size fields.
+template <typename T>
+struct PickleFieldTraits;
+
+#define MRPC_PICKLE_POD_FIELD_TRAITS(Type, Name)                         \
+  template <>                                                            \
+  struct PickleFieldTraits<Type> {                                       \
+    static const size_t kWireSize = (sizeof(Type) + 3) & ~size_t(3);     \
+    static bool Write(Pickle* pickle, Type value) {                      \
+      return pickle->Write##Name(value);                                 \
+    }                                                                    \
+    static bool Read(PickleIterator* iter, Type* value) {                \
+      return iter->Read##Name(value);                                    \
+    }                                                                    \
+    static void Add(PickleSizer* sizer, Type /* value */) {              \
+      sizer->Add##Name();                                                \
+    }                                                                    \
+    static void WriteRaw(char* dest, Type value) {                       \
+      memcpy(dest, &value, sizeof(value));                               \
+    }                                                                    \
+    static void ReadRaw(const char* src, Type* value) {                  \
+      memcpy(value, src, sizeof(*value));                                \
+    }                                                                    \
+  }
+
+MRPC_PICKLE_POD_FIELD_TRAITS(int32_t, Int);
+MRPC_PICKLE_POD_FIELD_TRAITS(uint16_t, UInt16);
+MRPC_PICKLE_POD_FIELD_TRAITS(uint32_t, UInt32);
+MRPC_PICKLE_POD_FIELD_TRAITS(int64_t, Int64);
+MRPC_PICKLE_POD_FIELD_TRAITS(uint64_t, UInt64);
+MRPC_PICKLE_POD_FIELD_TRAITS(float, Float);
+MRPC_PICKLE_POD_FIELD_TRAITS(double, Double);
+
+#undef MRPC_PICKLE_POD_FIELD_TRAITS
+
+template <>
+struct PickleFieldTraits<bool> {
+  static const size_t kWireSize = sizeof(int);
+  static bool Write(Pickle* pickle, bool value) {
+    return pickle->WriteBool(value);
+  }
+  static bool Read(PickleIterator* iter, bool* value) {
+    return iter->ReadBool(value);
+  }
+  static void Add(PickleSizer* sizer, bool /* value */) { sizer->AddBool(); }
+  static void WriteRaw(char* dest, bool value) {
+    int int_value = value ? 1 : 0;
+    memcpy(dest, &int_value, sizeof(int_value));
+  }
+  static void ReadRaw(const char* src, bool* value) {
+    int int_value;
+    memcpy(&int_value, src, sizeof(int_value));
+    *value = int_value != 0;
+  }
+};
+
+template <>
+struct PickleFieldTraits<std::string> {
+  static const size_t kWireSize = 0;
+  static bool Write(Pickle* pickle, const std::string& value) {
+    return pickle->WriteString(value);
+  }
+  static bool Read(PickleIterator* iter, std::string* value) {
+    return iter->ReadString(value);
+  }
+  static void Add(PickleSizer* sizer, const std::string& value) {
+    sizer->AddString(value);
+  }
+};
+
+// One field of a message: its type and the member it lives in.
+template <typename Message, typename T, T Message::*member>
+struct PickleField {
+  typedef PickleFieldTraits<T> Traits;
+  static const T& Get(const Message& message) { return message.*member; }
+  static T* GetMutable(Message* message) { return &(message->*member); }
+};
+
+#define MRPC_PICKLE_FIELD(Message, name) \
+  ::mrpc::PickleField<Message, decltype(Message::name), &Message::name>
+
+// The ordered field list of a message. Each level of the recursion handles
+// one field; the std::true_type/std::false_type overloads pick at compile
+// time whether it still belongs to the fixed-size prefix.
+template <typename... Fields>
+struct PickleFields;
+
+template <>
+struct PickleFields<> {
+  static constexpr size_t kFixedPrefixSize = 0;
+
+  template <typename Message>
+  static void WritePrefix(char* /* dest */, const Message& /* message */) {}
+  template <typename Message>
+  static bool WriteSuffix(Pickle* /* pickle */, const Message& /* message */) {
+    return true;
+  }
+  template <typename Message>
+  static bool WriteAll(Pickle* /* pickle */, const Message& /* message */) {
+    return true;
+  }
+  template <typename Message>
+  static void ReadPrefix(const char* /* src */, Message* /* message */) {}
+  template <typename Message>
+  static bool ReadSuffix(PickleIterator* /* iter */, Message* /* message */) {
+    return true;
+  }
+  template <typename Message>
+  static bool ReadAll(PickleIterator* /* iter */, Message* /* message */) {
+    return true;
+  }
+  template <typename Message>
+  static void AddAll(PickleSizer* /* sizer */, const Message& /* message */) {}
+};
+
+template <typename First, typename... Rest>
+struct PickleFields<First, Rest...> {
+  typedef typename First::Traits Traits;
+  typedef PickleFields<Rest...> Tail;
+  typedef std::integral_constant<bool, Traits::kWireSize != 0> IsFixed;
+
+  // Bytes taken by the leading run of fixed-size fields.
+  static constexpr size_t kFixedPrefixSize =
+      IsFixed::value ? Traits::kWireSize + Tail::kFixedPrefixSize : 0;
+
+  // Writes the fixed-size prefix into |dest|, which holds kFixedPrefixSize
+  // zeroed bytes.
+  template <typename Message>
+  static void WritePrefix(char* dest, const Message& message) {
+    WritePrefix(dest, message, IsFixed());
+  }
+  // Writes the fields after the fixed-size prefix.
+  template <typename Message>
+  static bool WriteSuffix(Pickle* pickle, const Message& message) {
+    return WriteSuffix(pickle, message, IsFixed());
+  }
+  template <typename Message>
+  static bool WriteAll(Pickle* pickle, const Message& message) {
+    return Traits::Write(pickle, First::Get(message)) &&
+           Tail::WriteAll(pickle, message);
+  }
+
+  template <typename Message>
+  static void ReadPrefix(const char* src, Message* message) {
+    ReadPrefix(src, message, IsFixed());
+  }
+  template <typename Message>
+  static bool ReadSuffix(PickleIterator* iter, Message* message) {
+    return ReadSuffix(iter, message, IsFixed());
+  }
+  template <typename Message>
+  static bool ReadAll(PickleIterator* iter, Message* message) {
+    return Traits::Read(iter, First::GetMutable(message)) &&
+           Tail::ReadAll(iter, message);
+  }
+
+  template <typename Message>
+  static void AddAll(PickleSizer* sizer, const Message& message) {
+    Traits::Add(sizer, First::Get(message));
+    Tail::AddAll(sizer, message);
+  }
+
+ private:
+  template <typename Message>
+  static void WritePrefix(char* dest, const Message& message, std::true_type) {
+    Traits::WriteRaw(dest, First::Get(message));
+    Tail::WritePrefix(dest + Traits::kWireSize, message);
+  }
+  template <typename Message>
+  static void WritePrefix(char*, const Message&, std::false_type) {}
+
+  template <typename Message>
+  static bool WriteSuffix(Pickle* pickle, const Message& message,
+                          std::true_type) {
+    return Tail::WriteSuffix(pickle, message);
+  }
+  template <typename Message>
+  static bool WriteSuffix(Pickle* pickle, const Message& message,
+                          std::false_type) {
+    return WriteAll(pickle, message);
+  }
+
+  template <typename Message>
+  static void ReadPrefix(const char* src, Message* message, std::true_type) {
+    Traits::ReadRaw(src, First::GetMutable(message));
+    Tail::ReadPrefix(src + Traits::kWireSize, message);
+  }
+  template <typename Message>
+  static void ReadPrefix(const char*, Message*, std::false_type) {}
+
+  template <typename Message>
+  static bool ReadSuffix(PickleIterator* iter, Message* message,
+                         std::true_type) {
+    return Tail::ReadSuffix(iter, message);
+  }
+  template <typename Message>
+  static bool ReadSuffix(PickleIterator* iter, Message* message,
+                         std::false_type) {
+    return ReadAll(iter, message);
+  }
+};
+
+namespace internal {
+
+// Gives the generated code access to the unchecked parts of Pickle and
+// PickleIterator.
+class PickleSchemaAccess {
+ public:
+  // The raw prefix layout assumes four-byte padding.
+  static bool CanWriteInPlace(const Pickle& pickle) {
+    return pickle.alignment_ == sizeof(uint32_t);
+  }
+  static char* ClaimBytes(Pickle* pickle, size_t num_bytes) {
+    return static_cast<char*>(pickle->ClaimBytes(num_bytes));
+  }
+
+  // A ChainedPickle may split the prefix across segments, so only read in
+  // place from the last (or only) segment.
+  static bool CanReadInPlace(const PickleIterator& iter) {
+    return iter.alignment_ == sizeof(uint32_t) &&
+           iter.next_segment_ == iter.end_segment_;
+  }
+  static const char* GetReadPointerAndAdvance(PickleIterator* iter,
+                                              size_t num_bytes) {
+    return iter->GetReadPointerAndAdvance(static_cast<int>(num_bytes));
+  }
+};
+
+}  // namespace internal
+
+template <typename Message>
+bool WritePickleMessage(Pickle* pickle, const Message& message) {
+  typedef typename PickleSchema<Message>::Fields Fields;
+  if (Fields::kFixedPrefixSize == 0 ||
+      !internal::PickleSchemaAccess::CanWriteInPlace(*pickle))
+    return Fields::WriteAll(pickle, message);
+  char* dest = internal::PickleSchemaAccess::ClaimBytes(
+      pickle, Fields::kFixedPrefixSize);
+  Fields::WritePrefix(dest, message);
+  return Fields::WriteSuffix(pickle, message);
+}
+
+template <typename Message>
+bool ReadPickleMessage(PickleIterator* iter, Message* message) {
+  typedef typename PickleSchema<Message>::Fields Fields;
+  if (Fields::kFixedPrefixSize == 0 ||
+      !internal::PickleSchemaAccess::CanReadInPlace(*iter))
+    return Fields::ReadAll(iter, message);
+  const char* src = internal::PickleSchemaAccess::GetReadPointerAndAdvance(
+      iter, Fields::kFixedPrefixSize);
+  if (!src)
+    return false;
+  Fields::ReadPrefix(src, message);
+  return Fields::ReadSuffix(iter, message);
+}
+
+template <typename Message>
+void AddPickleMessage(PickleSizer* sizer, const Message& message) {
+  PickleSchema<Message>::Fields::AddAll(sizer, message);
+}
+
+} // namespace mrpc
+#endif // MRPC_BASE_PICKLE_SCHEMA_H_
@@ -0,0 +1,192 @@
+#include "base/pickle_schema.h"
+#include "base/chained_pickle.h"
+#include <gtest/gtest.h>
+
+#include <string>
+
+using namespace mrpc;
+
+namespace {
+
+struct EchoRequest {
+  int32_t id;
+  bool urgent;
+  uint16_t port;
+  uint64_t deadline;
+  double weight;
+  std::string body;
+  int64_t trailer;
+};
+
+struct Empty {
+};
+
+struct StringsOnly {
+  std::string first;
+  std::string second;
+};
+
+}  // namespace
+
+namespace mrpc {
+
+template <>
+struct PickleSchema<EchoRequest> {
+  typedef PickleFields<MRPC_PICKLE_FIELD(EchoRequest, id),
+                       MRPC_PICKLE_FIELD(EchoRequest, urgent),
+                       MRPC_PICKLE_FIELD(EchoRequest, port),
+                       MRPC_PICKLE_FIELD(EchoRequest, deadline),
+                       MRPC_PICKLE_FIELD(EchoRequest, weight),
+                       MRPC_PICKLE_FIELD(EchoRequest, body),
+                       MRPC_PICKLE_FIELD(EchoRequest, trailer)> Fields;
+};
+
+template <>
+struct PickleSchema<Empty> {
+  typedef PickleFields<> Fields;
+};
+
+template <>
+struct PickleSchema<StringsOnly> {
+  typedef PickleFields<MRPC_PICKLE_FIELD(StringsOnly, first),
+                       MRPC_PICKLE_FIELD(StringsOnly, second)> Fields;
+};
+
+}  // namespace mrpc
+
+namespace {
+
+static_assert(PickleSchema<EchoRequest>::Fields::kFixedPrefixSize ==
+                  4 + 4 + 4 + 8 + 8,
+              "prefix covers id through weight");
+static_assert(PickleSchema<StringsOnly>::Fields::kFixedPrefixSize == 0,
+              "no fixed prefix before a string");
+
+EchoRequest MakeRequest() {
+  EchoRequest request;
+  request.id = 42;
+  request.urgent = true;
+  request.port = 8080;
+  request.deadline = 0xCE8CA9253104BDF7ULL;
+  request.weight = 2.71828182845904523;
+  request.body = "Hello world";
+  request.trailer = -7;
+  return request;
+}
+
+void WriteByHand(Pickle* pickle, const EchoRequest& request) {
+  pickle->WriteInt(request.id);
+  pickle->WriteBool(request.urgent);
+  pickle->WriteUInt16(request.port);
+  pickle->WriteUInt64(request.deadline);
+  pickle->WriteDouble(request.weight);
+  pickle->WriteString(request.body);
+  pickle->WriteInt64(request.trailer);
+}
+
+void ExpectEqual(const EchoRequest& expected, const EchoRequest& actual) {
+  EXPECT_EQ(expected.id, actual.id);
+  EXPECT_EQ(expected.urgent, actual.urgent);
+  EXPECT_EQ(expected.port, actual.port);
+  EXPECT_EQ(expected.deadline, actual.deadline);
+  EXPECT_EQ(expected.weight, actual.weight);
+  EXPECT_EQ(expected.body, actual.body);
+  EXPECT_EQ(expected.trailer, actual.trailer);
+}
+
+}  // namespace
+
+TEST(PickleSchemaTest, SameWireFormatAsHandWritten) {
+  EchoRequest request = MakeRequest();
+  Pickle generated;
+  EXPECT_TRUE(WritePickleMessage(&generated, request));
+  Pickle by_hand;
+  WriteByHand(&by_hand, request);
+
+  ASSERT_EQ(by_hand.size(), generated.size());
+  EXPECT_EQ(0, memcmp(by_hand.data(), generated.data(), by_hand.size()));
+
+  PickleSizer sizer;
+  AddPickleMessage(&sizer, request);
+  EXPECT_EQ(generated.payload_size(), sizer.payload_size());
+}
+
+TEST(PickleSchemaTest, RoundTrip) {
+  EchoRequest request = MakeRequest();
+  Pickle pickle;
+  EXPECT_TRUE(WritePickleMessage(&pickle, request));
+  EXPECT_TRUE(WritePickleMessage(&pickle, request));
+
+  PickleIterator iter(pickle);
+  EchoRequest first;
+  EXPECT_TRUE(ReadPickleMessage(&iter, &first));
+  ExpectEqual(request, first);
+  EchoRequest second;
+  EXPECT_TRUE(ReadPickleMessage(&iter, &second));
+  ExpectEqual(request, second);
+  EchoRequest none;
+  EXPECT_FALSE(ReadPickleMessage(&iter, &none));
+}
+
+TEST(PickleSchemaTest, CompactPickle) {
+  EchoRequest request = MakeRequest();
+  Pickle pickle(PICKLE_COMPACT);
+  EXPECT_TRUE(WritePickleMessage(&pickle, request));
+
+  PickleSizer sizer(PICKLE_COMPACT);
+  AddPickleMessage(&sizer, request);
+  EXPECT_EQ(pickle.payload_size(), sizer.payload_size());
+
+  PickleIterator iter(pickle);
+  EchoRequest result;
+  EXPECT_TRUE(ReadPickleMessage(&iter, &result));
+  ExpectEqual(request, result);
+}
+
+TEST(PickleSchemaTest, ChainedPickle) {
+  EchoRequest request = MakeRequest();
+  ChainedPickle chained(16);
+  for (int i = 0; i < 3; ++i) {
+    chained.WriteInt(request.id);
+    chained.WriteBool(request.urgent);
+    chained.WriteUInt16(request.port);
+    chained.WriteUInt64(request.deadline);
+    chained.WriteDouble(request.weight);
+    chained.WriteString(request.body);
+    chained.WriteInt64(request.trailer);
+  }
+
+  PickleIterator iter(chained);
+  for (int i = 0; i < 3; ++i) {
+    EchoRequest result;
+    EXPECT_TRUE(ReadPickleMessage(&iter, &result));
+    ExpectEqual(request, result);
+  }
+}
+
+TEST(PickleSchemaTest, Truncated) {
+  Pickle pickle;
+  pickle.WriteInt(42);
+  pickle.WriteBool(true);
+
+  PickleIterator iter(pickle);
+  EchoRequest result;
+  EXPECT_FALSE(ReadPickleMessage(&iter, &result));
+}
+
+TEST(PickleSchemaTest, NoFixedPrefix) {
+  StringsOnly strings;
+  strings.first = "first";
+  strings.second = "second";
+  Pickle pickle;
+  EXPECT_TRUE(WritePickleMessage(&pickle, strings));
+  EXPECT_TRUE(WritePickleMessage(&pickle, Empty()));
+
+  PickleIterator iter(pickle);
+  StringsOnly result;
+  EXPECT_TRUE(ReadPickleMessage(&iter, &result));
+  EXPECT_EQ("first", result.first);
+  EXPECT_EQ("second", result.second);
+  Empty empty;
+  EXPECT_TRUE(ReadPickleMessage(&iter, &empty));
+}
@@ -0,0 +1,160 @@
+#include "base/priority_scheduler.h"
+
+namespace mrpc {
+
+class PriorityScheduler::Worker : public Thread {
+ public:
+  Worker(PriorityScheduler* scheduler, bool reserved, const Options& options)
+    : Thread(options), scheduler_(scheduler), reserved_(reserved) {}
+
+  virtual void Run() override { scheduler_->WorkerLoop(reserved_); }
+
+ private:
+  PriorityScheduler* scheduler_;
+  bool reserved_;
+
+  DISALLOW_COPY_AND_ASSIGN(Worker);
+};
+
+PriorityScheduler::PriorityScheduler(const Options& options)
+  : starvation_limit_(options.starvation_limit()),
+    idle_reserved_workers_(0),
+    pending_reserved_wakeups_(0),
+    shutdown_(false) {
+  DCHECK_GT(options.num_threads(), 0);
+  DCHECK_GE(options.reserved_threads(), 0);
+  DCHECK_LT(options.reserved_threads(), options.num_threads());
+  for (int i = 0; i < kNumPriorities; ++i) {
+    tasks_run_[i] = 0;
+    tasks_expired_[i] = 0;
+  }
+  for (int i = 0; i < options.num_threads(); ++i) {
+    std::string name = std::string(options.name()) + "/" + std::to_string(i);
+    workers_.push_back(new Worker(this, i < options.reserved_threads(),
+        Thread::Options(name.c_str(), options.stack_size())));
+  }
+  for (size_t i = 0; i < workers_.size(); ++i)
+    workers_[i]->Start();
+}
+
+PriorityScheduler::~PriorityScheduler() {
+  {
+    LockGuard<Mutex> lock_guard(&mutex_);
+    shutdown_ = true;
+  }
+  high_priority_available_.NotifyAll();
+  work_available_.NotifyAll();
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    workers_[i]->Join();
+    delete workers_[i];
+  }
+}
+
+void PriorityScheduler::PostTask(Priority priority, const Closure& task) {
+  PostTaskWithDeadline(priority, task, TimeTicks());
+}
+
+void PriorityScheduler::PostTaskWithDeadline(Priority priority,
+                                             const Closure& task,
+                                             TimeTicks deadline,
+                                             const Closure& on_expired) {
+  DCHECK(priority >= 0 && priority < kNumPriorities);
+  LockGuard<Mutex> lock_guard(&mutex_);
+  DCHECK(!shutdown_);
+  queues_[priority].push_back(Task());
+  Task& queued = queues_[priority].back();
+  queued.task = task;
+  queued.on_expired = on_expired;
+  queued.deadline = deadline;
+  queued.posted = TimeTicks::Now();
+  // Interactive work goes to the reserved lane first, so it does not wait
+  // behind a worker busy with bulk work. A reserved worker that has been
+  // signalled but not yet woken up is taken; a second task goes to the
+  // other workers rather than wait for it.
+  if (priority == HIGH_PRIORITY &&
+      idle_reserved_workers_ > pending_reserved_wakeups_) {
+    ++pending_reserved_wakeups_;
+    high_priority_available_.NotifyOne();
+  } else {
+    work_available_.NotifyOne();
+  }
+}
+
+int PriorityScheduler::PickQueue(bool reserved, TimeTicks now) const {
+  if (reserved)
+    return queues_[HIGH_PRIORITY].empty() ? -1 : HIGH_PRIORITY;
+  // The longest-waiting task past the starvation limit, if any.
+  int starved = -1;
+  for (int i = HIGH_PRIORITY + 1; i < kNumPriorities; ++i) {
+    if (queues_[i].empty() ||
+        now - queues_[i].front().posted < starvation_limit_)
+      continue;
+    if (starved < 0 || queues_[i].front().posted < queues_[starved].front().posted)
+      starved = i;
+  }
+  if (starved >= 0)
+    return starved;
+  for (int i = 0; i < kNumPriorities; ++i) {
+    if (!queues_[i].empty())
+      return i;
+  }
+  return -1;
+}
+
+bool PriorityScheduler::TakeTask(bool reserved, Task* task, bool* expired) {
+  LockGuard<Mutex> lock_guard(&mutex_);
+  for (;;) {
+    TimeTicks now = TimeTicks::Now();
+    int queue = PickQueue(reserved, now);
+    if (queue >= 0) {
+      *task = std::move(queues_[queue].front());
+      queues_[queue].pop_front();
+      *expired = !task->deadline.IsNull() && now >= task->deadline;
+      if (*expired)
+        ++tasks_expired_[queue];
+      else
+        ++tasks_run_[queue];
+      return true;
+    }
+    if (shutdown_)
+      return false;
+    if (reserved) {
+      ++idle_reserved_workers_;
+      high_priority_available_.Wait(&mutex_);
+      --idle_reserved_workers_;
+      if (pending_reserved_wakeups_ > 0)
+        --pending_reserved_wakeups_;
+    } else {
+      work_available_.Wait(&mutex_);
+    }
+  }
+}
+
+void PriorityScheduler::WorkerLoop(bool reserved) {
+  Task task;
+  bool expired;
+  while (TakeTask(reserved, &task, &expired)) {
+    if (!expired)
+      task.task();
+    else if (task.on_expired)
+      task.on_expired();
+    task = Task();
+  }
+}
+
+int64_t PriorityScheduler::tasks_run(Priority priority) const {
+  LockGuard<Mutex> lock_guard(&mutex_);
+  return tasks_run_[priority];
+}
+
+int64_t PriorityScheduler::tasks_expired(Priority priority) const {
+  LockGuard<Mutex> lock_guard(&mutex_);
+  return tasks_expired_[priority];
+}
+
+size_t PriorityScheduler::queued_tasks(Priority priority) const {
+  LockGuard<Mutex> lock_guard(&mutex_);
+  return queues_[priority].size();
+}
+
+} // namespace mrpc
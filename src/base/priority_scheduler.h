@@ -0,0 +1,124 @@
+#ifndef MRPC_BASE_PRIORITY_SCHEDULER_H_
+#define MRPC_BASE_PRIORITY_SCHEDULER_H_
+
+#include <stdint.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "base/closure.h"
+#include "base/condition_variable.h"
+#include "base/macros.h"
+#include "base/mutex.h"
+#include "base/thread.h"
+#include "base/time.h"
+
+namespace mrpc {
+
+// Worker Threads that run posted Closures by priority, for servers that mix
+// latency-critical calls with bulk work.
+//
+// Each priority has its own FIFO run queue and a worker always takes from
+// the highest non-empty one, except that a task which has waited longer
+// than the starvation limit goes first, so that bulk work still makes
+// progress under a steady stream of interactive calls. Some workers can be
+// reserved for HIGH_PRIORITY tasks, so that bulk work never occupies every
+// thread. A task may carry a deadline; if it has not started by then it is
+// dropped, and its |on_expired| Closure runs instead.
+class PriorityScheduler {
+ public:
+  enum Priority {
+    HIGH_PRIORITY,
+    NORMAL_PRIORITY,
+    LOW_PRIORITY,
+  };
+  static const int kNumPriorities = 3;
+
+  class Options {
+   public:
+    Options(const char* name, int num_threads)
+      : name_(name),
+        num_threads_(num_threads),
+        reserved_threads_(0),
+        stack_size_(0),
+        starvation_limit_(TimeDelta::FromMilliseconds(100)) {}
+
+    const char* name() const { return name_; }
+    int num_threads() const { return num_threads_; }
+    // How many of the workers run only HIGH_PRIORITY tasks. Must leave at
+    // least one worker for the other priorities.
+    int reserved_threads() const { return reserved_threads_; }
+    void set_reserved_threads(int count) { reserved_threads_ = count; }
+    int stack_size() const { return stack_size_; }
+    void set_stack_size(int stack_size) { stack_size_ = stack_size; }
+    // How long a queued task may be passed over for higher priorities.
+    TimeDelta starvation_limit() const { return starvation_limit_; }
+    void set_starvation_limit(TimeDelta limit) { starvation_limit_ = limit; }
+
+   private:
+    const char* name_;
+    int num_threads_;
+    int reserved_threads_;
+    int stack_size_;
+    TimeDelta starvation_limit_;
+  };
+
+  // Starts the workers, named "<name>/<index>".
+  explicit PriorityScheduler(const Options& options);
+  // Runs, or expires, every task already posted, then joins the workers.
+  ~PriorityScheduler();
+
+  void PostTask(Priority priority, const Closure& task);
+  // Runs |task| only if a worker takes it before |deadline|; otherwise runs
+  // |on_expired|, if set, in its place.
+  void PostTaskWithDeadline(Priority priority, const Closure& task,
+                            TimeTicks deadline,
+                            const Closure& on_expired = Closure());
+
+  // Counts of tasks of |priority| that were started and that were dropped.
+  int64_t tasks_run(Priority priority) const;
+  int64_t tasks_expired(Priority priority) const;
+  // Tasks of |priority| still queued.
+  size_t queued_tasks(Priority priority) const;
+
+  int num_threads() const { return static_cast<int>(workers_.size()); }
+
+ private:
+  class Worker;
+
+  struct Task {
+    Closure task;
+    Closure on_expired;
+    TimeTicks deadline;  // Null for none.
+    TimeTicks posted;
+  };
+
+  // Waits for a task |reserved| workers may run and moves it to |task|.
+  // Sets |expired| if it is past its deadline. Returns false at shutdown.
+  bool TakeTask(bool reserved, Task* task, bool* expired);
+  // The queue to take from next, or -1. Called with |mutex_| held.
+  int PickQueue(bool reserved, TimeTicks now) const;
+  void WorkerLoop(bool reserved);
+
+  const TimeDelta starvation_limit_;
+  std::vector<Worker*> workers_;
+
+  mutable Mutex mutex_;
+  // Wakes the reserved workers, and the others.
+  ConditionVariable high_priority_available_;
+  ConditionVariable work_available_;
+  // All protected by |mutex_|.
+  std::deque<Task> queues_[kNumPriorities];
+  int idle_reserved_workers_;
+  // Signals sent to idle reserved workers that they have not woken up for.
+  int pending_reserved_wakeups_;
+  int64_t tasks_run_[kNumPriorities];
+  int64_t tasks_expired_[kNumPriorities];
+  bool shutdown_;
+
+  DISALLOW_COPY_AND_ASSIGN(PriorityScheduler);
+};
+
+} // namespace mrpc
+#endif // MRPC_BASE_PRIORITY_SCHEDULER_H_
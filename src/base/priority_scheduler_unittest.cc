@@ -0,0 +1,160 @@
+#include "base/priority_scheduler.h"
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "base/semaphore.h"
+
+using namespace mrpc;
+
+namespace {
+
+// Records the order tasks ran in.
+class Recorder {
+ public:
+  Closure Task(char name) {
+    return [this, name]() {
+      LockGuard<Mutex> lock_guard(&mutex_);
+      order_.push_back(name);
+    };
+  }
+
+  std::string order() {
+    LockGuard<Mutex> lock_guard(&mutex_);
+    return order_;
+  }
+
+ private:
+  Mutex mutex_;
+  std::string order_;
+};
+
+// Occupies a worker until Release().
+class Blocker {
+ public:
+  Blocker() : started_(0), release_(0) {}
+
+  Closure Task() {
+    return [this]() {
+      started_.Signal();
+      release_.Wait();
+    };
+  }
+  void WaitUntilStarted() { started_.Wait(); }
+  void Release() { release_.Signal(); }
+
+ private:
+  Semaphore started_;
+  Semaphore release_;
+};
+
+} // namespace
+
+TEST(PrioritySchedulerTest, RunsEveryTask) {
+  const int kTasks = 1000;
+  Semaphore done(0);
+  {
+    PriorityScheduler scheduler(PriorityScheduler::Options("sched", 4));
+    for (int i = 0; i < kTasks; ++i) {
+      scheduler.PostTask(
+          static_cast<PriorityScheduler::Priority>(
+              i % PriorityScheduler::kNumPriorities),
+          [&done]() { done.Signal(); });
+    }
+    for (int i = 0; i < kTasks; ++i)
+      done.Wait();
+    int64_t run = 0;
+    for (int i = 0; i < PriorityScheduler::kNumPriorities; ++i)
+      run += scheduler.tasks_run(static_cast<PriorityScheduler::Priority>(i));
+    EXPECT_EQ(kTasks, run);
+  }
+}
+
+TEST(PrioritySchedulerTest, HigherPrioritiesGoFirst) {
+  Recorder recorder;
+  Blocker blocker;
+  {
+    PriorityScheduler scheduler(PriorityScheduler::Options("sched", 1));
+    scheduler.PostTask(PriorityScheduler::LOW_PRIORITY, blocker.Task());
+    blocker.WaitUntilStarted();
+    scheduler.PostTask(PriorityScheduler::LOW_PRIORITY, recorder.Task('l'));
+    scheduler.PostTask(PriorityScheduler::NORMAL_PRIORITY, recorder.Task('n'));
+    scheduler.PostTask(PriorityScheduler::HIGH_PRIORITY, recorder.Task('h'));
+    scheduler.PostTask(PriorityScheduler::NORMAL_PRIORITY, recorder.Task('N'));
+    EXPECT_EQ(1u, scheduler.queued_tasks(PriorityScheduler::HIGH_PRIORITY));
+    blocker.Release();
+  }
+  EXPECT_EQ("hnNl", recorder.order());
+}
+
+TEST(PrioritySchedulerTest, DropsTasksPastTheirDeadline) {
+  Recorder recorder;
+  Blocker blocker;
+  {
+    PriorityScheduler scheduler(PriorityScheduler::Options("sched", 1));
+    scheduler.PostTask(PriorityScheduler::NORMAL_PRIORITY, blocker.Task());
+    blocker.WaitUntilStarted();
+    TimeTicks now = TimeTicks::Now();
+    scheduler.PostTaskWithDeadline(PriorityScheduler::HIGH_PRIORITY,
+                                   recorder.Task('x'),
+                                   now + TimeDelta::FromMilliseconds(1),
+                                   recorder.Task('e'));
+    scheduler.PostTaskWithDeadline(PriorityScheduler::HIGH_PRIORITY,
+                                   recorder.Task('y'),
+                                   now + TimeDelta::FromMilliseconds(1));
+    scheduler.PostTaskWithDeadline(PriorityScheduler::HIGH_PRIORITY,
+                                   recorder.Task('z'),
+                                   now + TimeDelta::FromSeconds(60));
+    Thread::Sleep(TimeDelta::FromMilliseconds(20));
+    blocker.Release();
+    while (scheduler.queued_tasks(PriorityScheduler::HIGH_PRIORITY) > 0)
+      Thread::YieldCurrentThread();
+    Thread::Sleep(TimeDelta::FromMilliseconds(10));
+    EXPECT_EQ(2, scheduler.tasks_expired(PriorityScheduler::HIGH_PRIORITY));
+    EXPECT_EQ(1, scheduler.tasks_run(PriorityScheduler::HIGH_PRIORITY));
+  }
+  EXPECT_EQ("ez", recorder.order());
+}
+
+TEST(PrioritySchedulerTest, StarvedTasksAreNotPassedOver) {
+  Recorder recorder;
+  Blocker blocker;
+  {
+    PriorityScheduler::Options options("sched", 1);
+    options.set_starvation_limit(TimeDelta::FromMilliseconds(10));
+    PriorityScheduler scheduler(options);
+    scheduler.PostTask(PriorityScheduler::HIGH_PRIORITY, blocker.Task());
+    blocker.WaitUntilStarted();
+    scheduler.PostTask(PriorityScheduler::LOW_PRIORITY, recorder.Task('l'));
+    Thread::Sleep(TimeDelta::FromMilliseconds(30));
+    scheduler.PostTask(PriorityScheduler::HIGH_PRIORITY, recorder.Task('h'));
+    scheduler.PostTask(PriorityScheduler::NORMAL_PRIORITY, recorder.Task('n'));
+    blocker.Release();
+  }
+  EXPECT_EQ("lhn", recorder.order());
+}
+
+TEST(PrioritySchedulerTest, ReservedWorkersServeOnlyHighPriority) {
+  Recorder recorder;
+  Blocker blocker;
+  Semaphore high_done(0);
+  {
+    PriorityScheduler::Options options("sched", 2);
+    options.set_reserved_threads(1);
+    PriorityScheduler scheduler(options);
+    // Bulk work holds the only general worker...
+    scheduler.PostTask(PriorityScheduler::LOW_PRIORITY, blocker.Task());
+    blocker.WaitUntilStarted();
+    scheduler.PostTask(PriorityScheduler::LOW_PRIORITY, recorder.Task('l'));
+    // ...yet interactive work still runs, on the reserved one.
+    scheduler.PostTask(PriorityScheduler::HIGH_PRIORITY, [&]() {
+      recorder.Task('h')();
+      high_done.Signal();
+    });
+    high_done.Wait();
+    EXPECT_EQ("h", recorder.order());
+    EXPECT_EQ(1u, scheduler.queued_tasks(PriorityScheduler::LOW_PRIORITY));
+    blocker.Release();
+  }
+  EXPECT_EQ("hl", recorder.order());
+}
@@ -0,0 +1,79 @@
+#include "base/rw_lock.h"
+
+#include <stdlib.h>
+
+#include "base/thread.h"
+
+namespace mrpc {
+
+thread_local int RWLock::reader_shard_ = -1;
+
+RWLock::RWLock() : writer_(0) {
+  for (int i = 0; i < kNumShards; ++i)
+    shards_[i].readers = 0;
+}
+
+RWLock::~RWLock() {
+  DCHECK_EQ(0, NoBarrier_Load(&writer_));
+}
+
+// static
+void* RWLock::operator new(size_t size) {
+  void* memory = nullptr;
+  CHECK_EQ(0, posix_memalign(&memory, ALIGNOF(RWLock), size))
+      << "Out of memory";
+  return memory;
+}
+
+// static
+void RWLock::operator delete(void* memory) {
+  free(memory);
+}
+
+// static
+int RWLock::ReaderShard() {
+  if (reader_shard_ < 0) {
+    // Round-robin, so that threads started together spread evenly.
+    static volatile Atomic32 next_shard = 0;
+    reader_shard_ =
+        static_cast<uint32_t>(Barrier_AtomicIncrement(&next_shard, 1)) %
+        kNumShards;
+  }
+  return reader_shard_;
+}
+
+void RWLock::ReadLock() {
+  Shard* shard = &shards_[ReaderShard()];
+  for (;;) {
+    // The increment is a full barrier, so either WriteLock() sees us in
+    // its scan or we see |writer_| set.
+    Barrier_AtomicIncrement(&shard->readers, 1);
+    if (NoBarrier_Load(&writer_) == 0)
+      return;
+    Barrier_AtomicIncrement(&shard->readers, -1);
+    // Sleep until the writer is done.
+    writer_mutex_.Lock();
+    writer_mutex_.Unlock();
+  }
+}
+
+void RWLock::ReadUnlock() {
+  Barrier_AtomicIncrement(&shards_[ReaderShard()].readers, -1);
+}
+
+void RWLock::WriteLock() {
+  writer_mutex_.Lock();
+  NoBarrier_Store(&writer_, 1);
+  MemoryBarrier();
+  for (int i = 0; i < kNumShards; ++i) {
+    while (Acquire_Load(&shards_[i].readers) != 0)
+      Thread::YieldCurrentThread();
+  }
+}
+
+void RWLock::WriteUnlock() {
+  Release_Store(&writer_, 0);
+  writer_mutex_.Unlock();
+}
+
+} // namespace mrpc
@@ -0,0 +1,84 @@
+#ifndef MRPC_BASE_RW_LOCK_H_
+#define MRPC_BASE_RW_LOCK_H_
+
+#include "base/atomicops.h"
+#include "base/futex_mutex.h"
+#include "base/lazy_instance.h"
+#include "base/macros.h"
+
+namespace mrpc {
+
+// A reader-writer lock for read-mostly state such as routing tables.
+//
+// Readers count themselves in one of kNumShards cache-line sized counters,
+// picked per thread, so concurrent readers on different cores do not bounce
+// a shared line. A writer announces itself, which turns new readers away,
+// and then waits for every shard to drain; writers therefore cost
+// O(kNumShards) and are not starved by a steady stream of readers.
+//
+// Not recursive: a thread holding a read lock must not take another one,
+// since a writer may be waiting in between.
+class RWLock final {
+ public:
+  RWLock();
+  ~RWLock();
+
+  void ReadLock();
+  void ReadUnlock();
+  void WriteLock();
+  void WriteUnlock();
+
+  static const int kNumShards = 16;
+
+  // Shards are cache-line aligned, which new only honours from C++17 on.
+  static void* operator new(size_t size);
+  static void operator delete(void* memory);
+  static void* operator new(size_t /* size */, void* place) { return place; }
+
+ private:
+  // Alone on its cache line, so that the shards do not share lines with
+  // each other or with neighbouring objects.
+  struct alignas(64) Shard {
+    volatile Atomic32 readers;
+  };
+
+  // The shard this thread counts itself in, in every RWLock.
+  static int ReaderShard();
+
+  Shard shards_[kNumShards];
+  // Held by the writer; readers turned away wait on it.
+  FutexMutex writer_mutex_;
+  volatile Atomic32 writer_;
+
+  static thread_local int reader_shard_;
+
+  DISALLOW_COPY_AND_ASSIGN(RWLock);
+};
+
+typedef LazyStaticInstance<RWLock,
+                           DefaultConstructTrait<RWLock>,
+                           ThreadSafeInitOnceTrait>::type LazyRWLock;
+#define LAZY_RW_LOCK_INITIALIZER LAZY_STATIC_INSTANCE_INITIALIZER
+
+class ReadLockGuard final {
+ public:
+  explicit ReadLockGuard(RWLock* lock) : lock_(lock) { lock_->ReadLock(); }
+  ~ReadLockGuard() { lock_->ReadUnlock(); }
+
+ private:
+  RWLock* lock_;
+  DISALLOW_COPY_AND_ASSIGN(ReadLockGuard);
+};
+
+class WriteLockGuard final {
+ public:
+  explicit WriteLockGuard(RWLock* lock) : lock_(lock) { lock_->WriteLock(); }
+  ~WriteLockGuard() { lock_->WriteUnlock(); }
+
+ private:
+  RWLock* lock_;
+  DISALLOW_COPY_AND_ASSIGN(WriteLockGuard);
+};
+
+} // namespace mrpc
+#endif // MRPC_BASE_RW_LOCK_H_
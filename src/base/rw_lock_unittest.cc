@@ -0,0 +1,128 @@
+#include "base/rw_lock.h"
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "base/thread.h"
+
+using namespace mrpc;
+
+namespace {
+
+// Two values that writers keep equal; a reader that sees them differ saw a
+// write in progress.
+struct Pair {
+  Pair() : a(0), b(0) {}
+  int64_t a;
+  int64_t b;
+};
+
+class PairThread : public Thread {
+ public:
+  PairThread(RWLock* lock, Pair* pair, bool writer, int iterations)
+    : Thread(Options(writer ? "writer" : "reader")),
+      lock_(lock),
+      pair_(pair),
+      writer_(writer),
+      iterations_(iterations),
+      torn_reads_(0) {}
+
+  virtual void Run() override {
+    for (int i = 0; i < iterations_; ++i) {
+      if (writer_) {
+        WriteLockGuard guard(lock_);
+        ++pair_->a;
+        ++pair_->b;
+      } else {
+        ReadLockGuard guard(lock_);
+        if (pair_->a != pair_->b)
+          ++torn_reads_;
+      }
+    }
+  }
+
+  int torn_reads() const { return torn_reads_; }
+
+ private:
+  RWLock* lock_;
+  Pair* pair_;
+  bool writer_;
+  int iterations_;
+  int torn_reads_;
+};
+
+// Holds a read lock until every reader holds one.
+class ConcurrentReader : public Thread {
+ public:
+  ConcurrentReader(RWLock* lock, volatile Atomic32* inside, int readers)
+    : Thread(Options("reader")), lock_(lock), inside_(inside),
+      readers_(readers) {}
+
+  virtual void Run() override {
+    ReadLockGuard guard(lock_);
+    Barrier_AtomicIncrement(inside_, 1);
+    while (Acquire_Load(inside_) < readers_)
+      Thread::YieldCurrentThread();
+  }
+
+ private:
+  RWLock* lock_;
+  volatile Atomic32* inside_;
+  int readers_;
+};
+
+LazyRWLock lazy_lock = LAZY_RW_LOCK_INITIALIZER;
+
+} // namespace
+
+TEST(RWLockTest, ReadersShareTheLock) {
+  const int kReaders = 8;
+  RWLock lock;
+  volatile Atomic32 inside = 0;
+  std::vector<ConcurrentReader*> readers;
+  for (int i = 0; i < kReaders; ++i) {
+    readers.push_back(new ConcurrentReader(&lock, &inside, kReaders));
+    readers.back()->Start();
+  }
+  for (size_t i = 0; i < readers.size(); ++i) {
+    readers[i]->Join();
+    delete readers[i];
+  }
+  EXPECT_EQ(kReaders, inside);
+  WriteLockGuard guard(&lock);
+}
+
+TEST(RWLockTest, WritersExcludeReadersAndWriters) {
+  const int kIterations = 20000;
+  RWLock lock;
+  Pair pair;
+  std::vector<PairThread*> threads;
+  for (int i = 0; i < 6; ++i) {
+    threads.push_back(new PairThread(&lock, &pair, i < 2, kIterations));
+    threads.back()->Start();
+  }
+  int torn_reads = 0;
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i]->Join();
+    torn_reads += threads[i]->torn_reads();
+    delete threads[i];
+  }
+  EXPECT_EQ(0, torn_reads);
+  EXPECT_EQ(2 * kIterations, pair.a);
+  EXPECT_EQ(pair.a, pair.b);
+}
+
+TEST(RWLockTest, LazyInstance) {
+  { ReadLockGuard guard(lazy_lock.Pointer()); }
+  { WriteLockGuard guard(lazy_lock.Pointer()); }
+  ReadLockGuard guard(lazy_lock.Pointer());
+}
+
+TEST(RWLockTest, CacheLineAligned) {
+  EXPECT_EQ(0u, ALIGNOF(RWLock) % 64);
+  RWLock* lock = new RWLock;
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(lock) % 64);
+  { WriteLockGuard guard(lock); }
+  delete lock;
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(lazy_lock.Pointer()) % 64);
+}
@@ -0,0 +1,123 @@
+#ifndef MRPC_BASE_SEQ_LOCK_H_
+#define MRPC_BASE_SEQ_LOCK_H_
+
+#include <string.h>
+
+#include <type_traits>
+
+#include "base/atomicops.h"
+#include "base/futex_mutex.h"
+#include "base/lazy_instance.h"
+#include "base/macros.h"
+#include "base/thread.h"
+
+namespace mrpc {
+
+// A sequence lock: writers never wait for readers and readers never write
+// shared memory, at the price of readers retrying when a write overlaps.
+// Suits small, frequently read, rarely written data.
+//
+// A write bumps the sequence to odd, updates the data and bumps it back to
+// even. A reader takes the sequence with ReadBegin(), reads, and retries if
+// ReadRetry() says the sequence moved. The data itself must be read and
+// written through atomic operations; SeqLocked<T> does that for plain
+// structs.
+class SeqLock final {
+ public:
+  SeqLock() : sequence_(0) {}
+
+  void WriteLock() {
+    writer_mutex_.Lock();
+    NoBarrier_Store(&sequence_, NoBarrier_Load(&sequence_) + 1);
+    // Data stores must not become visible before the odd sequence.
+    MemoryBarrier();
+  }
+  void WriteUnlock() {
+    Release_Store(&sequence_, NoBarrier_Load(&sequence_) + 1);
+    writer_mutex_.Unlock();
+  }
+
+  // Returns the sequence to pass to ReadRetry(), waiting out a write in
+  // progress.
+  Atomic32 ReadBegin() const {
+    Atomic32 sequence;
+    while ((sequence = Acquire_Load(&sequence_)) & 1)
+      Thread::YieldCurrentThread();
+    return sequence;
+  }
+  // True if a write overlapped the reads since ReadBegin().
+  bool ReadRetry(Atomic32 sequence) const {
+    // Data loads must complete before the sequence is checked again.
+    MemoryBarrier();
+    return NoBarrier_Load(&sequence_) != sequence;
+  }
+
+ private:
+  volatile Atomic32 sequence_;
+  FutexMutex writer_mutex_;
+
+  DISALLOW_COPY_AND_ASSIGN(SeqLock);
+};
+
+typedef LazyStaticInstance<SeqLock,
+                           DefaultConstructTrait<SeqLock>,
+                           ThreadSafeInitOnceTrait>::type LazySeqLock;
+#define LAZY_SEQ_LOCK_INITIALIZER LAZY_STATIC_INSTANCE_INITIALIZER
+
+class SeqLockWriteGuard final {
+ public:
+  explicit SeqLockWriteGuard(SeqLock* lock) : lock_(lock) {
+    lock_->WriteLock();
+  }
+  ~SeqLockWriteGuard() { lock_->WriteUnlock(); }
+
+ private:
+  SeqLock* lock_;
+  DISALLOW_COPY_AND_ASSIGN(SeqLockWriteGuard);
+};
+
+// A trivially copyable T, such as a config snapshot, that any number of
+// threads Load() while others Store() it. It is copied a word at a time, so
+// keep T small.
+template <typename T>
+class SeqLocked {
+ public:
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SeqLocked<T> copies T word by word");
+
+  SeqLocked() { Store(T()); }
+  explicit SeqLocked(const T& value) { Store(value); }
+
+  T Load() const {
+    AtomicWord words[kWords];
+    Atomic32 sequence;
+    do {
+      sequence = lock_.ReadBegin();
+      for (size_t i = 0; i < kWords; ++i)
+        words[i] = NoBarrier_Load(&words_[i]);
+    } while (lock_.ReadRetry(sequence));
+    T value;
+    memcpy(&value, words, sizeof(T));
+    return value;
+  }
+
+  void Store(const T& value) {
+    AtomicWord words[kWords] = {};
+    memcpy(words, &value, sizeof(T));
+    SeqLockWriteGuard guard(&lock_);
+    for (size_t i = 0; i < kWords; ++i)
+      NoBarrier_Store(&words_[i], words[i]);
+  }
+
+ private:
+  static const size_t kWords =
+      (sizeof(T) + sizeof(AtomicWord) - 1) / sizeof(AtomicWord);
+
+  SeqLock lock_;
+  volatile AtomicWord words_[kWords];
+
+  DISALLOW_COPY_AND_ASSIGN(SeqLocked);
+};
+
+} // namespace mrpc
+#endif // MRPC_BASE_SEQ_LOCK_H_
@@ -0,0 +1,86 @@
+#include "base/seq_lock.h"
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "base/thread.h"
+
+using namespace mrpc;
+
+namespace {
+
+struct Snapshot {
+  int64_t version;
+  int32_t values[5];
+};
+
+class SnapshotReader : public Thread {
+ public:
+  SnapshotReader(SeqLocked<Snapshot>* snapshot, volatile Atomic32* done)
+    : Thread(Options("reader")), snapshot_(snapshot), done_(done),
+      bad_reads_(0) {}
+
+  virtual void Run() override {
+    int64_t last_version = 0;
+    while (!Acquire_Load(done_)) {
+      Snapshot snapshot = snapshot_->Load();
+      bool consistent = snapshot.version >= last_version;
+      for (int i = 0; i < 5; ++i)
+        consistent &= snapshot.values[i] == static_cast<int32_t>(snapshot.version);
+      if (!consistent)
+        ++bad_reads_;
+      last_version = snapshot.version;
+    }
+  }
+
+  int bad_reads() const { return bad_reads_; }
+
+ private:
+  SeqLocked<Snapshot>* snapshot_;
+  volatile Atomic32* done_;
+  int bad_reads_;
+};
+
+LazySeqLock lazy_lock = LAZY_SEQ_LOCK_INITIALIZER;
+
+} // namespace
+
+TEST(SeqLockTest, ReadRetryDetectsWrites) {
+  SeqLock lock;
+  Atomic32 sequence = lock.ReadBegin();
+  EXPECT_FALSE(lock.ReadRetry(sequence));
+  { SeqLockWriteGuard guard(&lock); }
+  EXPECT_TRUE(lock.ReadRetry(sequence));
+  EXPECT_FALSE(lock.ReadRetry(lock.ReadBegin()));
+}
+
+TEST(SeqLockTest, LazyInstance) {
+  Atomic32 sequence = lazy_lock.Pointer()->ReadBegin();
+  { SeqLockWriteGuard guard(lazy_lock.Pointer()); }
+  EXPECT_TRUE(lazy_lock.Pointer()->ReadRetry(sequence));
+}
+
+TEST(SeqLockTest, ReadersNeverSeeTornSnapshots) {
+  Snapshot initial = {};
+  SeqLocked<Snapshot> snapshot(initial);
+  volatile Atomic32 done = 0;
+  std::vector<SnapshotReader*> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.push_back(new SnapshotReader(&snapshot, &done));
+    readers.back()->Start();
+  }
+  for (int version = 1; version <= 100000; ++version) {
+    Snapshot next;
+    next.version = version;
+    for (int i = 0; i < 5; ++i)
+      next.values[i] = version;
+    snapshot.Store(next);
+  }
+  Release_Store(&done, 1);
+  for (size_t i = 0; i < readers.size(); ++i) {
+    readers[i]->Join();
+    EXPECT_EQ(0, readers[i]->bad_reads());
+    delete readers[i];
+  }
+  EXPECT_EQ(100000, snapshot.Load().version);
+}
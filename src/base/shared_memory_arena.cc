@@ -0,0 +1,157 @@
+#include "base/shared_memory_arena.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace mrpc {
+
+namespace {
+
+const uint32_t kMagic = 0x6d726d61;  // "amrm"
+const uint32_t kVersion = 1;
+
+int CreateMemoryFd(const char* name) {
+#if defined(__NR_memfd_create)
+  return static_cast<int>(syscall(__NR_memfd_create, name, 1u /* CLOEXEC */));
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+} // namespace
+
+// The start of the region. |used| counts bytes from the start of the region,
+// header included, so that offsets and handles never need the header size.
+struct SharedMemoryArena::Header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t size;
+  volatile Atomic64 used;
+  char padding[64 - 2 * sizeof(uint32_t) - sizeof(uint64_t) -
+               sizeof(Atomic64)];
+};
+
+static_assert(sizeof(Atomic64) == sizeof(int64_t),
+              "the header layout must not depend on the process");
+
+// static
+SharedMemoryArena* SharedMemoryArena::Create(const char* name, size_t size) {
+  CHECK_GT(size, sizeof(Header));
+  // Offsets must fit in a Handle.
+  CHECK_LE(size, static_cast<uint64_t>(Handle::kInvalidValue) *
+                 kHandleAlignment);
+  int fd = CreateMemoryFd(name);
+  if (fd < 0) {
+    PLOG(ERROR) << "memfd_create failed";
+    return nullptr;
+  }
+  if (ftruncate(fd, size) != 0) {
+    PLOG(ERROR) << "ftruncate failed";
+    close(fd);
+    return nullptr;
+  }
+  void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    PLOG(ERROR) << "mmap failed";
+    close(fd);
+    return nullptr;
+  }
+  Header* header = static_cast<Header*>(base);
+  header->magic = kMagic;
+  header->version = kVersion;
+  header->size = size;
+  Release_Store(&header->used, sizeof(Header));
+  return new SharedMemoryArena(fd, static_cast<char*>(base), size);
+}
+
+// static
+SharedMemoryArena* SharedMemoryArena::Attach(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) <= sizeof(Header)) {
+    close(fd);
+    return nullptr;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    PLOG(ERROR) << "mmap failed";
+    close(fd);
+    return nullptr;
+  }
+  const Header* header = static_cast<const Header*>(base);
+  if (header->magic != kMagic || header->version != kVersion ||
+      header->size != size) {
+    LOG(ERROR) << "fd " << fd << " is not a shared memory arena";
+    munmap(base, size);
+    close(fd);
+    return nullptr;
+  }
+  return new SharedMemoryArena(fd, static_cast<char*>(base), size);
+}
+
+SharedMemoryArena::SharedMemoryArena(int fd, char* base, size_t size)
+  : fd_(fd),
+    base_(base),
+    size_(size),
+    header_(reinterpret_cast<Header*>(base)) {
+}
+
+SharedMemoryArena::~SharedMemoryArena() {
+  munmap(base_, size_);
+  close(fd_);
+}
+
+void* SharedMemoryArena::AllocAligned(size_t size, int align_as_int) {
+  const size_t align = static_cast<size_t>(
+      align_as_int < kHandleAlignment ? kHandleAlignment : align_as_int);
+  DCHECK_EQ(0u, align & (align - 1));
+  Atomic64 used = NoBarrier_Load(&header_->used);
+  for (;;) {
+    // The region is page-aligned, so aligning offsets aligns pointers.
+    size_t start = (static_cast<size_t>(used) + align - 1) & ~(align - 1);
+    if (start + size > size_ || start + size < start)
+      return nullptr;
+    Atomic64 end = static_cast<Atomic64>(start + size);
+    Atomic64 previous = NoBarrier_CompareAndSwap(&header_->used, used, end);
+    if (previous == used)
+      return base_ + start;
+    used = previous;
+  }
+}
+
+char* SharedMemoryArena::AllocWithHandle(size_t size, Handle* handle) {
+  char* memory = Alloc(size);
+  *handle = memory ? PointerToHandle(memory) : Handle();
+  return memory;
+}
+
+void* SharedMemoryArena::HandleToPointer(const Handle& handle) const {
+  CHECK(handle.valid());
+  size_t offset = static_cast<size_t>(handle.value()) * kHandleAlignment;
+  CHECK_LT(offset, size_);
+  return base_ + offset;
+}
+
+SharedMemoryArena::Handle SharedMemoryArena::PointerToHandle(
+    const void* memory) const {
+  const char* p = static_cast<const char*>(memory);
+  DCHECK(p >= base_ + sizeof(Header) && p < base_ + size_);
+  size_t offset = static_cast<size_t>(p - base_);
+  DCHECK_EQ(0u, offset % kHandleAlignment);
+  return Handle::FromValue(static_cast<uint32_t>(offset / kHandleAlignment));
+}
+
+void SharedMemoryArena::Reset() {
+  Release_Store(&header_->used, sizeof(Header));
+}
+
+size_t SharedMemoryArena::bytes_used() const {
+  return static_cast<size_t>(Acquire_Load(&header_->used)) - sizeof(Header);
+}
+
+} // namespace mrpc
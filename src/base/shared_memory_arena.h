@@ -0,0 +1,78 @@
+#ifndef MRPC_BASE_SHARED_MEMORY_ARENA_H_
+#define MRPC_BASE_SHARED_MEMORY_ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "base/arena.h"
+#include "base/atomicops.h"
+#include "base/macros.h"
+
+namespace mrpc {
+
+// An arena in a shared memory region, for passing large payloads between
+// processes on one host without copying them through a socket.
+//
+// The region is a memfd that the creating process hands to others, through
+// fork() or SCM_RIGHTS. Each process maps it wherever it likes, so pointers
+// are not portable but Handles are: a Handle is an offset into the region,
+// and HandleToPointer() turns it into a pointer in the local mapping.
+//
+// The allocation cursor lives in the region itself and is advanced with a
+// compare-and-swap, so every process that maps the region can allocate
+// from it concurrently. Reset() must only be called once no process uses
+// the memory any more.
+class SharedMemoryArena {
+ public:
+  typedef BaseArena::Handle Handle;
+
+  // Creates a |size| byte region. |name| only shows up in /proc/*/fd and
+  // /proc/*/maps. Returns nullptr on failure.
+  static SharedMemoryArena* Create(const char* name, size_t size);
+  // Maps the region behind |fd|, which was created by Create() in this or
+  // another process. Takes ownership of |fd|. Returns nullptr if |fd| is
+  // not such a region.
+  static SharedMemoryArena* Attach(int fd);
+
+  ~SharedMemoryArena();
+
+  // Returns nullptr when the region is full.
+  char* Alloc(size_t size) {
+    return static_cast<char*>(AllocAligned(size, kHandleAlignment));
+  }
+  void* AllocAligned(size_t size, int align);
+  // Memory is only reclaimed by Reset().
+  void Free(void* /* memory */, size_t /* size */) {}
+
+  // Allocates |size| bytes and sets |handle| to name them in any process.
+  // Returns nullptr, with |handle| invalid, when the region is full.
+  char* AllocWithHandle(size_t size, Handle* handle);
+  void* HandleToPointer(const Handle& handle) const;
+  // The handle of memory from Alloc() or AllocWithHandle().
+  Handle PointerToHandle(const void* memory) const;
+
+  void Reset();
+
+  int fd() const { return fd_; }
+  size_t size() const { return size_; }
+  size_t bytes_used() const;
+
+  // Handles count units of this many bytes, so a region can be up to
+  // 32 GB.
+  static const int kHandleAlignment = 8;
+
+ private:
+  struct Header;
+
+  SharedMemoryArena(int fd, char* base, size_t size);
+
+  const int fd_;
+  char* const base_;
+  const size_t size_;
+  Header* const header_;
+
+  DISALLOW_COPY_AND_ASSIGN(SharedMemoryArena);
+};
+
+} // namespace mrpc
+#endif // MRPC_BASE_SHARED_MEMORY_ARENA_H_
@@ -0,0 +1,100 @@
+#include "base/shared_memory_arena.h"
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <memory>
+
+using namespace mrpc;
+
+TEST(SharedMemoryArenaTest, HandlesRoundTrip) {
+  std::unique_ptr<SharedMemoryArena> arena(
+      SharedMemoryArena::Create("test", 1 << 20));
+  ASSERT_TRUE(arena != nullptr);
+  EXPECT_EQ(0u, arena->bytes_used());
+
+  SharedMemoryArena::Handle handle;
+  char* memory = arena->AllocWithHandle(100, &handle);
+  ASSERT_TRUE(handle.valid());
+  EXPECT_EQ(memory, arena->HandleToPointer(handle));
+  EXPECT_EQ(handle, arena->PointerToHandle(memory));
+  EXPECT_EQ(handle,
+            SharedMemoryArena::Handle::FromValue(handle.value()));
+
+  void* aligned = arena->AllocAligned(10, 64);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(aligned) % 64);
+
+  // Full regions fail cleanly.
+  EXPECT_EQ(nullptr, arena->Alloc(2 << 20));
+  EXPECT_FALSE(arena->AllocWithHandle(2 << 20, &handle) != nullptr);
+  EXPECT_FALSE(handle.valid());
+
+  arena->Reset();
+  EXPECT_EQ(0u, arena->bytes_used());
+  EXPECT_EQ(memory, arena->Alloc(100));
+}
+
+TEST(SharedMemoryArenaTest, AttachMapsTheSameMemory) {
+  std::unique_ptr<SharedMemoryArena> arena(
+      SharedMemoryArena::Create("test", 1 << 16));
+  ASSERT_TRUE(arena != nullptr);
+  SharedMemoryArena::Handle handle;
+  strcpy(arena->AllocWithHandle(6, &handle), "hello");
+
+  // A second mapping of the region lands at a different address.
+  std::unique_ptr<SharedMemoryArena> other(
+      SharedMemoryArena::Attach(dup(arena->fd())));
+  ASSERT_TRUE(other != nullptr);
+  EXPECT_NE(arena->HandleToPointer(handle), other->HandleToPointer(handle));
+  EXPECT_STREQ("hello", static_cast<char*>(other->HandleToPointer(handle)));
+
+  // Both mappings allocate from the same cursor.
+  char* a = arena->Alloc(8);
+  char* b = other->Alloc(8);
+  EXPECT_NE(arena->PointerToHandle(a), other->PointerToHandle(b));
+  EXPECT_EQ(arena->bytes_used(), other->bytes_used());
+}
+
+TEST(SharedMemoryArenaTest, AttachRejectsOtherFiles) {
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  close(fds[1]);
+  EXPECT_EQ(nullptr, SharedMemoryArena::Attach(fds[0]));
+}
+
+TEST(SharedMemoryArenaTest, WorksAcrossProcesses) {
+  std::unique_ptr<SharedMemoryArena> arena(
+      SharedMemoryArena::Create("test", 1 << 20));
+  ASSERT_TRUE(arena != nullptr);
+  SharedMemoryArena::Handle request;
+  memset(arena->AllocWithHandle(4096, &request), 'q', 4096);
+
+  int reply_pipe[2];
+  ASSERT_EQ(0, pipe(reply_pipe));
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    // The child maps the region afresh, as an unrelated process would.
+    SharedMemoryArena* child = SharedMemoryArena::Attach(dup(arena->fd()));
+    if (child == nullptr)
+      _exit(1);
+    const char* data = static_cast<char*>(child->HandleToPointer(request));
+    bool ok = data[0] == 'q' && data[4095] == 'q';
+    SharedMemoryArena::Handle reply;
+    strcpy(child->AllocWithHandle(16, &reply), ok ? "pong" : "bad");
+    uint32_t value = reply.value();
+    _exit(write(reply_pipe[1], &value, sizeof(value)) == sizeof(value) ? 0 : 1);
+  }
+  uint32_t value = 0;
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(value)),
+            read(reply_pipe[0], &value, sizeof(value)));
+  int status;
+  waitpid(pid, &status, 0);
+  EXPECT_EQ(0, WEXITSTATUS(status));
+  EXPECT_STREQ("pong", static_cast<char*>(arena->HandleToPointer(
+                           SharedMemoryArena::Handle::FromValue(value))));
+  close(reply_pipe[0]);
+  close(reply_pipe[1]);
+}
@@ -0,0 +1,274 @@
+#include "base/slab_allocator.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "base/atomicops.h"
+#include "base/ref_counted.h"
+
+namespace mrpc {
+
+namespace {
+
+const size_t kSlabSize = 64 * 1024;
+
+// 16-byte steps up to 256, then steps of a quarter to a half of a power of
+// two up to kMaxSize.
+const size_t kClassSizes[SlabAllocator::kNumClasses] = {
+  16, 32, 48, 64, 80, 96, 112, 128, 144, 160, 176, 192, 208, 224, 240, 256,
+  384, 512, 768, 1024, 1536, 2048, 3072, 4096,
+};
+
+volatile Atomic64 next_allocator_id = 0;
+
+} // namespace
+
+// Whether an allocator is still there to flush into. Thread caches hold a
+// reference, so this outlives the allocator when they do, and flush under
+// |mutex| so that the allocator cannot go away in the middle.
+struct SlabAllocator::Liveness : public RefCountedThreadSafe<Liveness> {
+  explicit Liveness(SlabAllocator* allocator) : allocator(allocator) {}
+
+  Mutex mutex;
+  SlabAllocator* allocator;  // NULL once destroyed. Protected by |mutex|.
+
+ private:
+  friend class RefCountedThreadSafe<Liveness>;
+  ~Liveness() {}
+};
+
+// A thread's free lists for one allocator. The entry is free when
+// |allocator_id| is 0; otherwise it holds a reference to |liveness|.
+struct SlabAllocator::ThreadCache {
+  struct FreeList {
+    FreeObject* head;
+    int count;
+  };
+
+  ThreadCache() : allocator_id(0), liveness(nullptr) {
+    memset(lists, 0, sizeof(lists));
+  }
+
+  ~ThreadCache() {
+    if (allocator_id)
+      FlushCache(this);
+  }
+
+  uint64_t allocator_id;
+  Liveness* liveness;
+  FreeList lists[kNumClasses];
+};
+
+thread_local SlabAllocator::ThreadCache
+    SlabAllocator::thread_caches_[kThreadCacheSize];
+thread_local int SlabAllocator::next_thread_cache_ = 0;
+
+SlabAllocator::SlabAllocator()
+  : id_(static_cast<uint64_t>(
+        NoBarrier_AtomicIncrement(&next_allocator_id, 1))),
+    liveness_(new Liveness(this)) {
+  liveness_->AddRef();
+}
+
+SlabAllocator::~SlabAllocator() {
+  {
+    LockGuard<Mutex> lock_guard(&liveness_->mutex);
+    liveness_->allocator = nullptr;
+  }
+  // Other threads drop their entries the next time they flush them.
+  for (int i = 0; i < kThreadCacheSize; ++i) {
+    ThreadCache* cache = &thread_caches_[i];
+    if (cache->allocator_id == id_) {
+      memset(cache->lists, 0, sizeof(cache->lists));
+      cache->allocator_id = 0;
+      cache->liveness = nullptr;
+      liveness_->Release();
+    }
+  }
+  liveness_->Release();
+  for (size_t i = 0; i < slabs_.size(); ++i)
+    free(slabs_[i]);
+}
+
+// static
+SlabAllocator* SlabAllocator::Default() {
+  static SlabAllocator* allocator = new SlabAllocator;
+  return allocator;
+}
+
+// static
+int SlabAllocator::SizeClass(size_t size) {
+  DCHECK_LE(size, kMaxSize);
+  if (size <= 256)
+    return size == 0 ? 0 : static_cast<int>((size - 1) / 16);
+  return static_cast<int>(
+      std::lower_bound(kClassSizes + 16, kClassSizes + kNumClasses, size) -
+      kClassSizes);
+}
+
+// static
+size_t SlabAllocator::ClassSize(int size_class) {
+  return kClassSizes[size_class];
+}
+
+// static
+int SlabAllocator::BatchSize(int size_class) {
+  // Move about 8 KB at a time, and never fewer than 4 objects.
+  return static_cast<int>(
+      std::max<size_t>(4, std::min<size_t>(64, 8192 / kClassSizes[size_class])));
+}
+
+SlabAllocator::ThreadCache* SlabAllocator::GetThreadCache() {
+  for (int i = 0; i < kThreadCacheSize; ++i) {
+    if (thread_caches_[i].allocator_id == id_)
+      return &thread_caches_[i];
+  }
+  return BindThreadCache();
+}
+
+SlabAllocator::ThreadCache* SlabAllocator::BindThreadCache() {
+  ThreadCache* cache = nullptr;
+  for (int i = 0; i < kThreadCacheSize && !cache; ++i) {
+    if (thread_caches_[i].allocator_id == 0)
+      cache = &thread_caches_[i];
+  }
+  if (!cache) {
+    cache = &thread_caches_[next_thread_cache_];
+    next_thread_cache_ = (next_thread_cache_ + 1) % kThreadCacheSize;
+    FlushCache(cache);
+  }
+  cache->allocator_id = id_;
+  cache->liveness = liveness_;
+  liveness_->AddRef();
+  return cache;
+}
+
+void* SlabAllocator::Alloc(size_t size) {
+  if (size > kMaxSize)
+    return malloc(size);
+  int size_class = SizeClass(size);
+  ThreadCache* cache = GetThreadCache();
+  ThreadCache::FreeList* list = &cache->lists[size_class];
+  FreeObject* object = list->head;
+  if (object) {
+    list->head = object->next;
+    --list->count;
+    return object;
+  }
+  return FetchFromCentral(cache, size_class);
+}
+
+void SlabAllocator::Free(void* memory, size_t size) {
+  if (!memory)
+    return;
+  if (size > kMaxSize) {
+    free(memory);
+    return;
+  }
+  int size_class = SizeClass(size);
+  ThreadCache* cache = GetThreadCache();
+  ThreadCache::FreeList* list = &cache->lists[size_class];
+  FreeObject* object = static_cast<FreeObject*>(memory);
+  object->next = list->head;
+  list->head = object;
+  // Keep up to two batches, so that a thread alternating between Alloc()
+  // and Free() at a batch boundary does not go to the central list each
+  // time.
+  int batch = BatchSize(size_class);
+  if (++list->count > 2 * batch)
+    ReleaseToCentral(cache, size_class, batch);
+}
+
+void* SlabAllocator::FetchFromCentral(ThreadCache* cache, int size_class) {
+  const size_t object_size = kClassSizes[size_class];
+  const int batch = BatchSize(size_class);
+  CentralList* central = &central_[size_class];
+  ThreadCache::FreeList* list = &cache->lists[size_class];
+
+  LockGuard<Mutex> lock_guard(&central->mutex);
+  int fetched = 0;
+  while (fetched < batch && central->head) {
+    FreeObject* object = central->head;
+    central->head = object->next;
+    --central->count;
+    object->next = list->head;
+    list->head = object;
+    ++fetched;
+  }
+  while (fetched < batch) {
+    if (central->slab_cursor + object_size > central->slab_end) {
+      char* slab = static_cast<char*>(malloc(kSlabSize));
+      CHECK(slab) << "Out of memory";
+      {
+        LockGuard<Mutex> slabs_lock_guard(&slabs_mutex_);
+        slabs_.push_back(slab);
+      }
+      central->slab_cursor = slab;
+      central->slab_end = slab + kSlabSize;
+    }
+    FreeObject* object = reinterpret_cast<FreeObject*>(central->slab_cursor);
+    central->slab_cursor += object_size;
+    object->next = list->head;
+    list->head = object;
+    ++fetched;
+  }
+  list->count += fetched;
+
+  FreeObject* object = list->head;
+  list->head = object->next;
+  --list->count;
+  return object;
+}
+
+void SlabAllocator::ReleaseToCentral(ThreadCache* cache, int size_class,
+                                     int count) {
+  ThreadCache::FreeList* list = &cache->lists[size_class];
+  FreeObject* first = list->head;
+  FreeObject* last = first;
+  for (int i = 1; i < count; ++i)
+    last = last->next;
+  list->head = last->next;
+  list->count -= count;
+
+  CentralList* central = &central_[size_class];
+  LockGuard<Mutex> lock_guard(&central->mutex);
+  last->next = central->head;
+  central->head = first;
+  central->count += count;
+}
+
+void SlabAllocator::FlushThreadCache() {
+  for (int i = 0; i < kThreadCacheSize; ++i) {
+    if (thread_caches_[i].allocator_id == id_)
+      FlushCache(&thread_caches_[i]);
+  }
+}
+
+// static
+void SlabAllocator::FlushCache(ThreadCache* cache) {
+  Liveness* liveness = cache->liveness;
+  {
+    LockGuard<Mutex> lock_guard(&liveness->mutex);
+    if (liveness->allocator) {
+      for (int i = 0; i < kNumClasses; ++i) {
+        if (cache->lists[i].count > 0)
+          liveness->allocator->ReleaseToCentral(cache, i,
+                                                cache->lists[i].count);
+      }
+    }
+  }
+  memset(cache->lists, 0, sizeof(cache->lists));
+  cache->allocator_id = 0;
+  cache->liveness = nullptr;
+  liveness->Release();
+}
+
+size_t SlabAllocator::central_free_count(size_t size) {
+  CentralList* central = &central_[SizeClass(size)];
+  LockGuard<Mutex> lock_guard(&central->mutex);
+  return central->count;
+}
+
+} // namespace mrpc
@@ -0,0 +1,107 @@
+#ifndef MRPC_BASE_SLAB_ALLOCATOR_H_
+#define MRPC_BASE_SLAB_ALLOCATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "base/macros.h"
+#include "base/mutex.h"
+
+namespace mrpc {
+
+// An allocator for objects of a few fixed sizes that outlive a single
+// request, such as connection state or pending-call records, which arenas
+// cannot free out of order.
+//
+// Requests are rounded up to a size class. Each thread keeps a free list
+// per class and allocates and frees on it without locking. It refills from,
+// and overflows to, a locked central list per class a batch at a time; the
+// central lists carve new objects out of malloc'd slabs. Memory goes back
+// to the system only when the allocator is destroyed.
+//
+// A thread caches free lists for the last few allocators it used, so
+// alternating between a handful of them stays on the thread's own lists.
+//
+// A SlabAllocator must outlive the objects it handed out. Threads flush
+// their cache to it when they exit or need its entry for another
+// allocator; caches of an allocator that is already gone are dropped.
+class SlabAllocator {
+ public:
+  SlabAllocator();
+  ~SlabAllocator();
+
+  // |size| must be passed back to Free(). Sizes over kMaxSize go to malloc.
+  void* Alloc(size_t size);
+  void Free(void* memory, size_t size);
+
+  // Returns the calling thread's cached objects to the central lists.
+  void FlushThreadCache();
+
+  // Objects on the central free list of |size|'s class, for tests.
+  size_t central_free_count(size_t size);
+
+  // A process-wide allocator, never destroyed.
+  static SlabAllocator* Default();
+
+  static const size_t kMaxSize = 4096;
+  static const int kNumClasses = 24;
+
+  // The class for |size| bytes, and the object size of a class.
+  static int SizeClass(size_t size);
+  static size_t ClassSize(int size_class);
+  // How many objects move between a thread and the central list at once.
+  static int BatchSize(int size_class);
+
+ private:
+  struct FreeObject {
+    FreeObject* next;
+  };
+
+  struct CentralList {
+    CentralList() : head(nullptr), count(0), slab_cursor(nullptr),
+                    slab_end(nullptr) {}
+
+    Mutex mutex;
+    FreeObject* head;
+    size_t count;
+    char* slab_cursor;
+    char* slab_end;
+  };
+
+  struct ThreadCache;
+  struct Liveness;
+
+  ThreadCache* GetThreadCache();
+  // Takes a free entry, or empties the least recently bound one, for this
+  // allocator.
+  ThreadCache* BindThreadCache();
+  // Moves up to a batch of objects of |size_class| into |cache|, and
+  // returns one of them.
+  void* FetchFromCentral(ThreadCache* cache, int size_class);
+  // Hands |count| objects from the head of |cache|'s list back.
+  void ReleaseToCentral(ThreadCache* cache, int size_class, int count);
+  // Empties |cache| into its allocator, if that is still alive, and frees
+  // the entry.
+  static void FlushCache(ThreadCache* cache);
+
+  // Never reused, so a cache entry cannot be taken for a new allocator that
+  // happens to have a destroyed one's address.
+  const uint64_t id_;
+  // Shared with the thread caches that hold free lists of this allocator.
+  Liveness* liveness_;
+  CentralList central_[kNumClasses];
+
+  Mutex slabs_mutex_;
+  std::vector<char*> slabs_;  // Protected by |slabs_mutex_|.
+
+  static const int kThreadCacheSize = 4;
+  static thread_local ThreadCache thread_caches_[kThreadCacheSize];
+  static thread_local int next_thread_cache_;
+
+  DISALLOW_COPY_AND_ASSIGN(SlabAllocator);
+};
+
+} // namespace mrpc
+#endif // MRPC_BASE_SLAB_ALLOCATOR_H_
@@ -0,0 +1,175 @@
+#include "base/slab_allocator.h"
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <set>
+#include <vector>
+
+#include "base/thread.h"
+
+using namespace mrpc;
+
+namespace {
+
+class ChurnThread : public Thread {
+ public:
+  ChurnThread(SlabAllocator* allocator, uint8_t tag)
+    : Thread(Options("slab_churn")), allocator_(allocator), tag_(tag),
+      ok_(true) {}
+
+  virtual void Run() override {
+    std::vector<char*> live;
+    for (int i = 0; i < 50000; ++i) {
+      size_t size = 8 + (i * 37) % 600;
+      char* memory = static_cast<char*>(allocator_->Alloc(size));
+      memset(memory, tag_, size);
+      live.push_back(memory);
+      sizes_.push_back(size);
+      if (i % 3 == 2) {
+        // Free an older object, out of order.
+        size_t index = (i * 7) % live.size();
+        if (live[index]) {
+          for (size_t j = 0; j < sizes_[index]; ++j)
+            ok_ = ok_ && static_cast<uint8_t>(live[index][j]) == tag_;
+          allocator_->Free(live[index], sizes_[index]);
+          live[index] = nullptr;
+        }
+      }
+    }
+    for (size_t i = 0; i < live.size(); ++i)
+      allocator_->Free(live[i], sizes_[i]);
+  }
+
+  bool ok() const { return ok_; }
+
+ private:
+  SlabAllocator* allocator_;
+  uint8_t tag_;
+  std::vector<size_t> sizes_;
+  bool ok_;
+};
+
+class DestroyThread : public Thread {
+ public:
+  explicit DestroyThread(SlabAllocator* allocator)
+    : Thread(Options("slab_destroy")), allocator_(allocator) {}
+
+  virtual void Run() override { allocator_->~SlabAllocator(); }
+
+ private:
+  SlabAllocator* allocator_;
+};
+
+} // namespace
+
+TEST(SlabAllocatorTest, SizeClasses) {
+  EXPECT_EQ(16u, SlabAllocator::ClassSize(SlabAllocator::SizeClass(1)));
+  EXPECT_EQ(16u, SlabAllocator::ClassSize(SlabAllocator::SizeClass(16)));
+  EXPECT_EQ(32u, SlabAllocator::ClassSize(SlabAllocator::SizeClass(17)));
+  EXPECT_EQ(256u, SlabAllocator::ClassSize(SlabAllocator::SizeClass(256)));
+  EXPECT_EQ(384u, SlabAllocator::ClassSize(SlabAllocator::SizeClass(257)));
+  EXPECT_EQ(4096u, SlabAllocator::ClassSize(SlabAllocator::SizeClass(4096)));
+  for (size_t size = 1; size <= SlabAllocator::kMaxSize; ++size) {
+    int size_class = SlabAllocator::SizeClass(size);
+    ASSERT_GE(SlabAllocator::ClassSize(size_class), size);
+    if (size_class > 0) {
+      ASSERT_LT(SlabAllocator::ClassSize(size_class - 1), size);
+    }
+  }
+}
+
+TEST(SlabAllocatorTest, ReusesFreedObjects) {
+  SlabAllocator allocator;
+  void* first = allocator.Alloc(100);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(first) % 16);
+  allocator.Free(first, 100);
+  // LIFO per size class, from the thread cache.
+  EXPECT_EQ(first, allocator.Alloc(112));
+
+  void* big = allocator.Alloc(SlabAllocator::kMaxSize + 1);
+  allocator.Free(big, SlabAllocator::kMaxSize + 1);
+}
+
+TEST(SlabAllocatorTest, BatchesMoveToTheCentralList) {
+  SlabAllocator allocator;
+  const int batch = SlabAllocator::BatchSize(SlabAllocator::SizeClass(64));
+  std::vector<void*> objects;
+  for (int i = 0; i < 3 * batch; ++i)
+    objects.push_back(allocator.Alloc(64));
+  EXPECT_EQ(0u, allocator.central_free_count(64));
+  for (size_t i = 0; i < objects.size(); ++i)
+    allocator.Free(objects[i], 64);
+  // The thread keeps up to two batches and hands one back.
+  EXPECT_EQ(static_cast<size_t>(batch), allocator.central_free_count(64));
+  allocator.FlushThreadCache();
+  EXPECT_EQ(objects.size(), allocator.central_free_count(64));
+}
+
+TEST(SlabAllocatorTest, ThreadsShareObjects) {
+  SlabAllocator allocator;
+  std::vector<ChurnThread*> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.push_back(new ChurnThread(&allocator, static_cast<uint8_t>(i + 1)));
+    threads.back()->Start();
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i]->Join();
+    EXPECT_TRUE(threads[i]->ok());
+    delete threads[i];
+  }
+  // Exiting threads flushed their caches.
+  EXPECT_GT(allocator.central_free_count(64), 0u);
+}
+
+TEST(SlabAllocatorTest, DefaultIsShared) {
+  EXPECT_EQ(SlabAllocator::Default(), SlabAllocator::Default());
+  void* memory = SlabAllocator::Default()->Alloc(24);
+  SlabAllocator::Default()->Free(memory, 24);
+}
+
+TEST(SlabAllocatorTest, NewAllocatorAtSameAddress) {
+  alignas(SlabAllocator) char storage[sizeof(SlabAllocator)];
+  SlabAllocator* allocator = new (storage) SlabAllocator;
+  allocator->Free(allocator->Alloc(64), 64);
+
+  // Another thread destroys the allocator, leaving this thread's cache
+  // pointing at it, and a new one takes its place.
+  DestroyThread destroyer(allocator);
+  destroyer.Start();
+  destroyer.Join();
+  allocator = new (storage) SlabAllocator;
+
+  // The stale free list is dropped, so the new allocator fetches a fresh
+  // batch and gets all of it back on flush.
+  allocator->Free(allocator->Alloc(64), 64);
+  allocator->FlushThreadCache();
+  EXPECT_EQ(static_cast<size_t>(
+                SlabAllocator::BatchSize(SlabAllocator::SizeClass(64))),
+            allocator->central_free_count(64));
+  allocator->~SlabAllocator();
+}
+
+TEST(SlabAllocatorTest, AlternatingAllocatorsKeepTheirCaches) {
+  SlabAllocator first;
+  SlabAllocator second;
+  void* memory = first.Alloc(64);
+  first.Free(memory, 64);
+  second.Free(second.Alloc(64), 64);
+  // Using |second| left |first|'s free list on this thread.
+  EXPECT_EQ(0u, first.central_free_count(64));
+  EXPECT_EQ(memory, first.Alloc(64));
+  first.Free(memory, 64);
+}
+
+TEST(SlabAllocatorTest, LeastRecentlyBoundCacheIsFlushed) {
+  // More allocators than a thread caches free lists for.
+  const int kAllocators = 8;
+  SlabAllocator allocators[kAllocators];
+  for (int i = 0; i < kAllocators; ++i)
+    allocators[i].Free(allocators[i].Alloc(64), 64);
+  EXPECT_EQ(static_cast<size_t>(
+                SlabAllocator::BatchSize(SlabAllocator::SizeClass(64))),
+            allocators[0].central_free_count(64));
+  EXPECT_EQ(0u, allocators[kAllocators - 1].central_free_count(64));
+}
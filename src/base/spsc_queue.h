@@ -0,0 +1,180 @@
+#ifndef MRPC_BASE_SPSC_QUEUE_H_
+#define MRPC_BASE_SPSC_QUEUE_H_
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/macros.h"
+#include "base/thread.h"
+#include "base/waiters.h"
+
+namespace mrpc {
+
+// A bounded queue between exactly one producer thread and one consumer
+// thread, such as an I/O thread feeding a decoder.
+//
+// Each side owns one index and keeps a cached copy of the other's, which it
+// refreshes only when the cache says the queue is full (producer) or empty
+// (consumer). A handoff therefore usually touches no cache line the other
+// side writes except the slot itself. The batch calls move many items per
+// index update.
+//
+// Push() and Pop() wait according to the WaitStrategy; TryPush() and
+// TryPop() never wait. T must be default constructible and movable.
+template <typename T>
+class SpscQueue {
+ public:
+  enum WaitStrategy {
+    // Poll without pause: lowest latency, burns a core while waiting.
+    BUSY_SPIN,
+    // Poll with Thread::YieldCurrentThread() in between.
+    YIELD,
+    // Sleep on a Semaphore. Every publish then pays for a memory barrier.
+    BLOCK,
+  };
+
+  // |capacity| must be a power of two, and at least 2.
+  explicit SpscQueue(size_t capacity, WaitStrategy wait_strategy = YIELD)
+    : slots_(capacity),
+      mask_(capacity - 1),
+      wait_strategy_(wait_strategy),
+      tail_(0),
+      cached_head_(0),
+      head_(0),
+      cached_tail_(0) {
+    DCHECK_GE(capacity, 2u);
+    DCHECK_EQ(0u, capacity & (capacity - 1));
+  }
+
+  // Producer only. Returns false, leaving |item| alone, when full.
+  bool TryPush(T&& item) {
+    return TryPushBatch(&item, 1) == 1;
+  }
+  bool TryPush(const T& item) {
+    T copy(item);
+    return TryPush(std::move(copy));
+  }
+  // Producer only. Moves as many of |items| as fit and publishes them at
+  // once. Returns how many were taken.
+  size_t TryPushBatch(T* items, size_t count) {
+    AtomicWord tail = NoBarrier_Load(&tail_);
+    size_t space = capacity() - static_cast<size_t>(tail - cached_head_);
+    if (space < count) {
+      cached_head_ = Acquire_Load(&head_);
+      space = capacity() - static_cast<size_t>(tail - cached_head_);
+    }
+    size_t n = std::min(space, count);
+    if (n == 0)
+      return 0;
+    for (size_t i = 0; i < n; ++i)
+      slots_[(tail + i) & mask_] = std::move(items[i]);
+    Release_Store(&tail_, tail + n);
+    if (wait_strategy_ == BLOCK)
+      not_empty_.WakeOne();
+    return n;
+  }
+  // Producer only. Waits while the queue is full.
+  void Push(T item) {
+    Wait(&not_full_, [&]() { return TryPush(std::move(item)); });
+  }
+  // Producer only. Waits until every one of |items| is queued.
+  void PushBatch(T* items, size_t count) {
+    size_t pushed = 0;
+    Wait(&not_full_, [&]() {
+      pushed += TryPushBatch(items + pushed, count - pushed);
+      return pushed == count;
+    });
+  }
+
+  // Consumer only. Returns false when empty.
+  bool TryPop(T* item) {
+    return TryPopBatch(item, 1) == 1;
+  }
+  // Consumer only. Moves up to |max_count| items to |items| and releases
+  // their slots at once. Returns how many were taken.
+  size_t TryPopBatch(T* items, size_t max_count) {
+    AtomicWord head = NoBarrier_Load(&head_);
+    size_t available = static_cast<size_t>(cached_tail_ - head);
+    if (available < max_count) {
+      cached_tail_ = Acquire_Load(&tail_);
+      available = static_cast<size_t>(cached_tail_ - head);
+    }
+    size_t n = std::min(available, max_count);
+    if (n == 0)
+      return 0;
+    for (size_t i = 0; i < n; ++i)
+      items[i] = std::move(slots_[(head + i) & mask_]);
+    Release_Store(&head_, head + n);
+    if (wait_strategy_ == BLOCK)
+      not_full_.WakeOne();
+    return n;
+  }
+  // Consumer only. Waits while the queue is empty.
+  void Pop(T* item) {
+    Wait(&not_empty_, [&]() { return TryPop(item); });
+  }
+  // Consumer only. Waits until at least one item is queued, then takes up
+  // to |max_count|.
+  size_t PopBatch(T* items, size_t max_count) {
+    size_t popped = 0;
+    Wait(&not_empty_, [&]() {
+      popped = TryPopBatch(items, max_count);
+      return popped > 0;
+    });
+    return popped;
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+  WaitStrategy wait_strategy() const { return wait_strategy_; }
+
+ private:
+  // Retries |done| until it returns true, waiting per |wait_strategy_| in
+  // between. |waiters| is woken by the other side.
+  template <typename Done>
+  void Wait(Waiters* waiters, Done done) {
+    while (!done()) {
+      switch (wait_strategy_) {
+        case BUSY_SPIN:
+          break;
+        case YIELD:
+          Thread::YieldCurrentThread();
+          break;
+        case BLOCK:
+          waiters->Prepare();
+          if (done()) {
+            waiters->Cancel();
+            return;
+          }
+          waiters->Wait();
+          break;
+      }
+    }
+  }
+
+  std::vector<T> slots_;
+  const AtomicWord mask_;
+  const WaitStrategy wait_strategy_;
+  char padding0_[64];
+
+  // Written by the producer.
+  volatile AtomicWord tail_;
+  AtomicWord cached_head_;
+  char padding1_[64 - 2 * sizeof(AtomicWord)];
+
+  // Written by the consumer.
+  volatile AtomicWord head_;
+  AtomicWord cached_tail_;
+  char padding2_[64 - 2 * sizeof(AtomicWord)];
+
+  Waiters not_empty_;
+  Waiters not_full_;
+
+  DISALLOW_COPY_AND_ASSIGN(SpscQueue);
+};
+
+} // namespace mrpc
+#endif // MRPC_BASE_SPSC_QUEUE_H_
@@ -0,0 +1,133 @@
+#include "base/spsc_queue.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "base/thread.h"
+
+using namespace mrpc;
+
+namespace {
+
+const int kItems = 200000;
+
+// Pushes 0, 1, ..., kItems - 1, in batches of |batch| if it is above 1.
+class Producer : public Thread {
+ public:
+  Producer(SpscQueue<int>* queue, int batch)
+    : Thread(Options("producer")), queue_(queue), batch_(batch) {}
+
+  virtual void Run() override {
+    if (batch_ <= 1) {
+      for (int i = 0; i < kItems; ++i)
+        queue_->Push(i);
+      return;
+    }
+    std::vector<int> items(batch_);
+    for (int i = 0; i < kItems; i += batch_) {
+      int count = std::min(batch_, kItems - i);
+      for (int j = 0; j < count; ++j)
+        items[j] = i + j;
+      queue_->PushBatch(&items[0], count);
+    }
+  }
+
+ private:
+  SpscQueue<int>* queue_;
+  int batch_;
+};
+
+// Pops every item and checks they arrive in order.
+void ConsumeInOrder(SpscQueue<int>* queue, int batch) {
+  int expected = 0;
+  std::vector<int> items(std::max(batch, 1));
+  while (expected < kItems) {
+    size_t count = 1;
+    if (batch <= 1)
+      queue->Pop(&items[0]);
+    else
+      count = queue->PopBatch(&items[0], batch);
+    for (size_t i = 0; i < count; ++i) {
+      ASSERT_EQ(expected, items[i]);
+      ++expected;
+    }
+  }
+  int extra;
+  EXPECT_FALSE(queue->TryPop(&extra));
+}
+
+void Transfer(SpscQueue<int>::WaitStrategy strategy, int capacity,
+              int batch) {
+  SpscQueue<int> queue(capacity, strategy);
+  Producer producer(&queue, batch);
+  producer.Start();
+  ConsumeInOrder(&queue, batch);
+  producer.Join();
+}
+
+} // namespace
+
+TEST(SpscQueueTest, FifoUntilFull) {
+  SpscQueue<int> queue(4);
+  int value;
+  EXPECT_FALSE(queue.TryPop(&value));
+  for (int lap = 0; lap < 3; ++lap) {
+    for (int i = 0; i < 4; ++i)
+      EXPECT_TRUE(queue.TryPush(i));
+    EXPECT_FALSE(queue.TryPush(4));
+    for (int i = 0; i < 4; ++i) {
+      ASSERT_TRUE(queue.TryPop(&value));
+      EXPECT_EQ(i, value);
+    }
+    EXPECT_FALSE(queue.TryPop(&value));
+  }
+}
+
+TEST(SpscQueueTest, BatchesTakeWhatFits) {
+  SpscQueue<int> queue(8);
+  int in[6] = {0, 1, 2, 3, 4, 5};
+  EXPECT_EQ(6u, queue.TryPushBatch(in, 6));
+  // Only two slots are left.
+  EXPECT_EQ(2u, queue.TryPushBatch(in, 6));
+  int out[16];
+  EXPECT_EQ(5u, queue.TryPopBatch(out, 5));
+  EXPECT_EQ(4, out[4]);
+  // Wraps around the end of the ring.
+  EXPECT_EQ(5u, queue.TryPushBatch(in, 5));
+  EXPECT_EQ(8u, queue.TryPopBatch(out, 16));
+  int expected[8] = {5, 0, 1, 0, 1, 2, 3, 4};
+  for (int i = 0; i < 8; ++i)
+    EXPECT_EQ(expected[i], out[i]);
+  EXPECT_EQ(0u, queue.TryPopBatch(out, 16));
+}
+
+TEST(SpscQueueTest, MoveOnlyItems) {
+  SpscQueue<std::unique_ptr<int> > queue(2);
+  EXPECT_TRUE(queue.TryPush(std::unique_ptr<int>(new int(1))));
+  EXPECT_TRUE(queue.TryPush(std::unique_ptr<int>(new int(2))));
+  std::unique_ptr<int> rejected(new int(3));
+  EXPECT_FALSE(queue.TryPush(std::move(rejected)));
+  ASSERT_TRUE(rejected != nullptr);
+  std::unique_ptr<int> popped;
+  queue.Pop(&popped);
+  EXPECT_EQ(1, *popped);
+}
+
+TEST(SpscQueueTest, BusySpinTransfersInOrder) {
+  // Room for every item, so the spinning sides rarely wait for each other
+  // even when they share a core.
+  Transfer(SpscQueue<int>::BUSY_SPIN, 1 << 18, 1);
+}
+
+TEST(SpscQueueTest, YieldTransfersInOrder) {
+  Transfer(SpscQueue<int>::YIELD, 256, 1);
+  Transfer(SpscQueue<int>::YIELD, 256, 32);
+}
+
+TEST(SpscQueueTest, BlockTransfersInOrder) {
+  // Small rings make both sides sleep often.
+  Transfer(SpscQueue<int>::BLOCK, 4, 1);
+  Transfer(SpscQueue<int>::BLOCK, 16, 7);
+}
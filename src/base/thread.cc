@@ -34,12 +34,24 @@ void SetThreadName(const char* name) {
 	0,0,0);
 }
 
+void SetThreadAffinity(int cpu) {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set),
+                                      &cpu_set);
+  if (result != 0)
+    LOG(WARNING) << "Failed to pin thread to cpu " << cpu << ": " << result;
+}
+
 void* ThreadEntry(void* arg) {
   Thread* thread = reinterpret_cast<Thread*>(arg);  
   {
     LockGuard<Mutex> lock_guard(&thread->data()->thread_creation_mutex_);
   }
   SetThreadName(thread->name());
+  if (thread->cpu() >= 0)
+    SetThreadAffinity(thread->cpu());
   DCHECK(thread->data()->thread_ != kInvalidThread);
   thread->NotifyStartedAndRun();
   return nullptr;
@@ -50,7 +62,9 @@ void* ThreadEntry(void* arg) {
 Thread::Thread(const Options& options) 
   : data_(new PlatformData),
     stack_size_(options.stack_size()),
-    joinable_(options.joinable()) {
+    joinable_(options.joinable()),
+    cpu_(options.cpu()),
+    start_semaphore_(nullptr) {
   set_name(options.name());
 }
 
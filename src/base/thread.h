@@ -18,14 +18,16 @@ class Thread {
    public:
     Options() : name_("mrpc:<unknown>"), 
 	        stack_size_(0), 
-		joinable_(true) {}
+		joinable_(true),
+		cpu_(-1) {}
 
     explicit Options(const char* name, 
 		     int stack_size = 0,
 		     bool joinable = true)
       : name_(name),
 	stack_size_(stack_size),
-	joinable_(joinable) {}
+	joinable_(joinable),
+	cpu_(-1) {}
 
     const char* name() const { return name_; }
     int stack_size() const { return stack_size_; }
@@ -34,11 +36,16 @@ class Thread {
     //void set_detached(bool )
     void EnableJoinable() { joinable_ = true; }
     void EnableDetached() { joinable_ = false; }
+    // Pins the thread to |cpu| once it starts. -1, the default, leaves it
+    // free to run anywhere.
+    int cpu() const { return cpu_; }
+    void set_cpu(int cpu) { cpu_ = cpu; }
 
    private:
     const char* name_;
     int stack_size_;
     bool joinable_;
+    int cpu_;
   };
   
   // Create new thread.
@@ -54,6 +61,8 @@ class Thread {
     return name_;
   }
 
+  int cpu() const { return cpu_; }
+
   virtual void Run() = 0;
 
   static ThreadId CurrentId();
@@ -81,6 +90,7 @@ class Thread {
   char name_[kMaxThreadNameLength];
   int stack_size_;
   bool joinable_;
+  int cpu_;
   Semaphore* start_semaphore_;
 
   DISALLOW_COPY_AND_ASSIGN(Thread);
@@ -0,0 +1,194 @@
+#include "base/thread_pool.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "base/semaphore.h"
+
+namespace mrpc {
+
+class ThreadPool::Worker : public Thread {
+ public:
+  Worker(ThreadPool* pool, int index, const Options& options)
+    : Thread(options), pool_(pool), index_(index), steal_seed_(index + 1) {}
+
+  virtual void Run() override { pool_->WorkerLoop(this); }
+
+  ThreadPool* pool() const { return pool_; }
+  int index() const { return index_; }
+  WorkStealingDeque<Closure>* deque() { return &deque_; }
+
+  // A cheap xorshift, to spread thieves over the victims.
+  uint32_t NextVictimSeed() {
+    steal_seed_ ^= steal_seed_ << 13;
+    steal_seed_ ^= steal_seed_ >> 17;
+    steal_seed_ ^= steal_seed_ << 5;
+    return steal_seed_;
+  }
+
+ private:
+  ThreadPool* pool_;
+  int index_;
+  uint32_t steal_seed_;
+  WorkStealingDeque<Closure> deque_;
+
+  DISALLOW_COPY_AND_ASSIGN(Worker);
+};
+
+thread_local ThreadPool::Worker* ThreadPool::current_worker_ = nullptr;
+
+ThreadPool::ThreadPool(const char* name, int num_threads, int stack_size)
+  : shutdown_(false),
+    pending_tasks_(0),
+    idle_workers_(0) {
+  DCHECK_GT(num_threads, 0);
+  for (int i = 0; i < num_threads; ++i) {
+    std::string worker_name = std::string(name) + "/" + std::to_string(i);
+    workers_.push_back(
+        new Worker(this, i, Thread::Options(worker_name.c_str(), stack_size)));
+  }
+  for (size_t i = 0; i < workers_.size(); ++i)
+    workers_[i]->Start();
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    LockGuard<Mutex> lock_guard(&mutex_);
+    shutdown_ = true;
+  }
+  work_available_.NotifyAll();
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    workers_[i]->Join();
+    delete workers_[i];
+  }
+}
+
+void ThreadPool::PostTask(const Closure& task) {
+  Closure* closure = new Closure(task);
+  // Count the task before it becomes visible, so that a worker taking it at
+  // once never drives the count below zero.
+  Barrier_AtomicIncrement(&pending_tasks_, 1);
+  Worker* self = current_worker_;
+  if (self && self->pool() == this) {
+    self->deque()->Push(closure);
+  } else {
+    LockGuard<Mutex> lock_guard(&mutex_);
+    shared_queue_.push_back(closure);
+  }
+  WakeWorker();
+}
+
+void ThreadPool::WakeWorker() {
+  // Pairs with the barrier in WorkerLoop(): either the worker sees the new
+  // task before it sleeps, or we see it idle and wake it.
+  MemoryBarrier();
+  if (NoBarrier_Load(&idle_workers_) > 0) {
+    LockGuard<Mutex> lock_guard(&mutex_);
+    work_available_.NotifyOne();
+  }
+}
+
+Closure* ThreadPool::TakeTask(Worker* self) {
+  Closure* task = nullptr;
+  if (self && self->pool() == this)
+    task = self->deque()->Pop();
+  if (!task) {
+    LockGuard<Mutex> lock_guard(&mutex_);
+    if (!shared_queue_.empty()) {
+      task = shared_queue_.front();
+      shared_queue_.pop_front();
+    }
+  }
+  if (!task) {
+    size_t count = workers_.size();
+    size_t start = self ? self->NextVictimSeed() % count : 0;
+    for (size_t i = 0; i < count && !task; ++i) {
+      Worker* victim = workers_[(start + i) % count];
+      if (victim != self)
+        task = victim->deque()->Steal();
+    }
+  }
+  if (task)
+    Barrier_AtomicIncrement(&pending_tasks_, -1);
+  return task;
+}
+
+void ThreadPool::WorkerLoop(Worker* self) {
+  current_worker_ = self;
+  for (;;) {
+    Closure* task = TakeTask(self);
+    if (task) {
+      (*task)();
+      delete task;
+      continue;
+    }
+    // A steal can lose a race while tasks are still pending; retry rather
+    // than sleep on them.
+    if (Acquire_Load(&pending_tasks_) > 0) {
+      Thread::YieldCurrentThread();
+      continue;
+    }
+
+    LockGuard<Mutex> lock_guard(&mutex_);
+    Barrier_AtomicIncrement(&idle_workers_, 1);
+    MemoryBarrier();
+    while (Acquire_Load(&pending_tasks_) == 0 && !shutdown_)
+      work_available_.Wait(&mutex_);
+    Barrier_AtomicIncrement(&idle_workers_, -1);
+    if (shutdown_ && Acquire_Load(&pending_tasks_) == 0)
+      break;
+  }
+  current_worker_ = nullptr;
+}
+
+namespace {
+
+struct ParallelForState {
+  ParallelForState(int64_t begin, int64_t end, int64_t grain,
+                   const std::function<void(int64_t)>& body)
+    : next(begin), end(end), grain(grain), remaining(end - begin),
+      body(body), done(0) {}
+
+  // Runs chunks until none are left.
+  void RunChunks() {
+    for (;;) {
+      int64_t chunk_begin = Barrier_AtomicIncrement(&next, grain) - grain;
+      if (chunk_begin >= end)
+        return;
+      int64_t chunk_end = std::min(chunk_begin + grain, end);
+      for (int64_t i = chunk_begin; i < chunk_end; ++i)
+        body(i);
+      if (Barrier_AtomicIncrement(&remaining, -(chunk_end - chunk_begin)) == 0)
+        done.Signal();
+    }
+  }
+
+  volatile Atomic64 next;
+  const int64_t end;
+  const int64_t grain;
+  volatile Atomic64 remaining;
+  const std::function<void(int64_t)> body;
+  Semaphore done;
+};
+
+} // namespace
+
+void ThreadPool::ParallelFor(int64_t begin, int64_t end, int64_t grain,
+                             const std::function<void(int64_t)>& body) {
+  if (begin >= end)
+    return;
+  DCHECK_GT(grain, 0);
+  // Helpers may start after the loop is finished, so they share ownership
+  // of the state.
+  std::shared_ptr<ParallelForState> state(
+      new ParallelForState(begin, end, grain, body));
+  int64_t chunks = (end - begin + grain - 1) / grain;
+  int64_t helpers = std::min<int64_t>(chunks - 1, workers_.size());
+  for (int64_t i = 0; i < helpers; ++i)
+    PostTask([state]() { state->RunChunks(); });
+  state->RunChunks();
+  state->done.Wait();
+}
+
+} // namespace mrpc
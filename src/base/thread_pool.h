@@ -0,0 +1,71 @@
+#ifndef MRPC_BASE_THREAD_POOL_H_
+#define MRPC_BASE_THREAD_POOL_H_
+
+#include <stdint.h>
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/closure.h"
+#include "base/condition_variable.h"
+#include "base/macros.h"
+#include "base/mutex.h"
+#include "base/thread.h"
+#include "base/work_stealing_deque.h"
+
+namespace mrpc {
+
+// A fixed set of worker Threads that run posted Closures.
+//
+// Each worker owns a WorkStealingDeque. Tasks posted from a worker go to the
+// bottom of its own deque, where it pops them LIFO while they are still
+// cache-hot; tasks posted from other threads go to a shared queue. An idle
+// worker steals from the top of the other workers' deques before it sleeps.
+class ThreadPool {
+ public:
+  // Starts |num_threads| workers named "<name>/<index>". |stack_size| is
+  // passed to Thread::Options; 0 picks the Thread default.
+  ThreadPool(const char* name, int num_threads, int stack_size = 0);
+  // Runs every task already posted, then joins the workers.
+  ~ThreadPool();
+
+  void PostTask(const Closure& task);
+
+  // Runs |body(i)| for every i in [begin, end), in chunks of |grain|
+  // indices, and returns once all of them have run. The calling thread
+  // takes chunks too, so nested calls from inside a task cannot deadlock.
+  void ParallelFor(int64_t begin, int64_t end, int64_t grain,
+                   const std::function<void(int64_t)>& body);
+
+  int num_threads() const { return static_cast<int>(workers_.size()); }
+
+ private:
+  class Worker;
+
+  // Takes a task from the deque of |self|, the shared queue, or another
+  // worker, in that order. |self| is nullptr on a non-worker thread.
+  Closure* TakeTask(Worker* self);
+  void WorkerLoop(Worker* self);
+  void WakeWorker();
+
+  // The Worker running on this thread, of any pool.
+  static thread_local Worker* current_worker_;
+
+  std::vector<Worker*> workers_;
+
+  Mutex mutex_;
+  ConditionVariable work_available_;
+  std::deque<Closure*> shared_queue_;  // Protected by |mutex_|.
+  bool shutdown_;                      // Protected by |mutex_|.
+
+  // Tasks posted and not yet taken, wherever they are queued.
+  volatile Atomic32 pending_tasks_;
+  volatile Atomic32 idle_workers_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+} // namespace mrpc
+#endif // MRPC_BASE_THREAD_POOL_H_
@@ -0,0 +1,141 @@
+#include "base/thread_pool.h"
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "base/work_stealing_deque.h"
+
+using namespace mrpc;
+
+namespace {
+
+class StealThread : public Thread {
+ public:
+  StealThread(WorkStealingDeque<int>* deque, std::vector<int>* stolen)
+    : Thread(Options("stealer")), deque_(deque), stolen_(stolen), done_(0) {}
+
+  virtual void Run() override {
+    while (!Acquire_Load(&done_) || !deque_->IsEmpty()) {
+      int* item = deque_->Steal();
+      if (item)
+        stolen_->push_back(*item);
+    }
+  }
+
+  void Finish() { Release_Store(&done_, 1); }
+
+ private:
+  WorkStealingDeque<int>* deque_;
+  std::vector<int>* stolen_;
+  volatile Atomic32 done_;
+};
+
+} // namespace
+
+TEST(WorkStealingDequeTest, OwnerIsLifoThievesAreFifo) {
+  WorkStealingDeque<int> deque(1);
+  int items[5] = {0, 1, 2, 3, 4};
+  for (int i = 0; i < 5; ++i)
+    deque.Push(&items[i]);
+  EXPECT_EQ(&items[0], deque.Steal());
+  EXPECT_EQ(&items[4], deque.Pop());
+  EXPECT_EQ(&items[1], deque.Steal());
+  EXPECT_EQ(&items[3], deque.Pop());
+  EXPECT_EQ(&items[2], deque.Pop());
+  EXPECT_EQ(nullptr, deque.Pop());
+  EXPECT_EQ(nullptr, deque.Steal());
+  EXPECT_TRUE(deque.IsEmpty());
+}
+
+TEST(WorkStealingDequeTest, EveryItemIsTakenOnce) {
+  const int kItems = 100000;
+  std::vector<int> items(kItems);
+  WorkStealingDeque<int> deque(2);
+  std::vector<int> stolen[3];
+  std::vector<StealThread*> thieves;
+  for (int i = 0; i < 3; ++i) {
+    thieves.push_back(new StealThread(&deque, &stolen[i]));
+    thieves.back()->Start();
+  }
+
+  std::vector<int> popped;
+  for (int i = 0; i < kItems; ++i) {
+    items[i] = i;
+    deque.Push(&items[i]);
+    if (i % 3 == 0) {
+      int* item = deque.Pop();
+      if (item)
+        popped.push_back(*item);
+    }
+  }
+  while (int* item = deque.Pop())
+    popped.push_back(*item);
+  for (size_t i = 0; i < thieves.size(); ++i) {
+    thieves[i]->Finish();
+    thieves[i]->Join();
+    delete thieves[i];
+  }
+
+  std::vector<int> seen(kItems, 0);
+  for (size_t i = 0; i < popped.size(); ++i)
+    ++seen[popped[i]];
+  for (int t = 0; t < 3; ++t) {
+    for (size_t i = 0; i < stolen[t].size(); ++i)
+      ++seen[stolen[t][i]];
+  }
+  for (int i = 0; i < kItems; ++i)
+    ASSERT_EQ(1, seen[i]) << "item " << i;
+}
+
+TEST(ThreadPoolTest, RunsPostedTasks) {
+  volatile Atomic32 count = 0;
+  {
+    ThreadPool pool("test", 4);
+    EXPECT_EQ(4, pool.num_threads());
+    for (int i = 0; i < 1000; ++i)
+      pool.PostTask([&count]() { Barrier_AtomicIncrement(&count, 1); });
+  }
+  // The destructor runs everything already posted.
+  EXPECT_EQ(1000, count);
+}
+
+TEST(ThreadPoolTest, TasksPostedFromWorkersAreStolen) {
+  ThreadPool pool("test", 4);
+  volatile Atomic32 count = 0;
+  Semaphore done(0);
+  const int kTasks = 10000;
+  pool.PostTask([&]() {
+    for (int i = 0; i < kTasks; ++i) {
+      pool.PostTask([&]() {
+        if (Barrier_AtomicIncrement(&count, 1) == kTasks)
+          done.Signal();
+      });
+    }
+  });
+  done.Wait();
+  EXPECT_EQ(kTasks, count);
+}
+
+TEST(ThreadPoolTest, ParallelFor) {
+  ThreadPool pool("test", 4);
+  std::vector<int> values(10007, 0);
+  pool.ParallelFor(0, values.size(), 64, [&values](int64_t i) {
+    values[i] += static_cast<int>(i);
+  });
+  for (size_t i = 0; i < values.size(); ++i)
+    ASSERT_EQ(static_cast<int>(i), values[i]);
+
+  // An empty range returns at once.
+  pool.ParallelFor(5, 5, 1, [](int64_t) { FAIL(); });
+}
+
+TEST(ThreadPoolTest, NestedParallelFor) {
+  ThreadPool pool("test", 2);
+  volatile Atomic64 sum = 0;
+  pool.ParallelFor(0, 16, 1, [&](int64_t /* i */) {
+    pool.ParallelFor(0, 100, 10, [&](int64_t j) {
+      Barrier_AtomicIncrement(&sum, j);
+    });
+  });
+  EXPECT_EQ(16 * 4950, sum);
+}
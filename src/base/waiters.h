@@ -0,0 +1,56 @@
+#ifndef MRPC_BASE_WAITERS_H_
+#define MRPC_BASE_WAITERS_H_
+
+#include "base/atomicops.h"
+#include "base/macros.h"
+#include "base/semaphore.h"
+
+namespace mrpc {
+
+// Threads sleeping until a lock-free structure changes, such as consumers
+// of an empty queue.
+//
+// A sleeper registers with Prepare(), checks the structure once more, then
+// either Wait()s or backs out with Cancel(). The other side calls WakeOne()
+// after each change. Registering and WakeOne()'s check are both full
+// barriers, so a wake-up cannot slip in between the check and the sleep,
+// and WakeOne() costs no system call while nobody sleeps.
+class Waiters final {
+ public:
+  Waiters() : count_(0), semaphore_(0) {}
+
+  void Prepare() { Barrier_AtomicIncrement(&count_, 1); }
+  void Wait() { semaphore_.Wait(); }
+  void Cancel() {
+    if (!Claim()) {
+      // A waker already claimed this sleeper; take its signal.
+      semaphore_.Wait();
+    }
+  }
+  void WakeOne() {
+    MemoryBarrier();
+    if (NoBarrier_Load(&count_) > 0 && Claim())
+      semaphore_.Signal();
+  }
+
+ private:
+  // Takes one sleeper off the count. Returns false if there is none.
+  bool Claim() {
+    Atomic32 count = NoBarrier_Load(&count_);
+    while (count > 0) {
+      Atomic32 previous = NoBarrier_CompareAndSwap(&count_, count, count - 1);
+      if (previous == count)
+        return true;
+      count = previous;
+    }
+    return false;
+  }
+
+  volatile Atomic32 count_;
+  Semaphore semaphore_;
+
+  DISALLOW_COPY_AND_ASSIGN(Waiters);
+};
+
+} // namespace mrpc
+#endif // MRPC_BASE_WAITERS_H_
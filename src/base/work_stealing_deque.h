@@ -0,0 +1,133 @@
+#ifndef MRPC_BASE_WORK_STEALING_DEQUE_H_
+#define MRPC_BASE_WORK_STEALING_DEQUE_H_
+
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/macros.h"
+
+namespace mrpc {
+
+// A Chase-Lev work-stealing deque of T pointers ("Dynamic Circular
+// Work-Stealing Deque", with the memory orderings of Le et al., "Correct and
+// Efficient Work-Stealing for Weak Memory Models").
+//
+// One owner thread pushes and pops at the bottom, LIFO, without any atomic
+// read-modify-write in the common case. Any number of other threads steal
+// from the top, FIFO, with a single compare-and-swap.
+//
+// The buffer doubles when full. Outgrown buffers may still be read by a
+// racing thief, so they are kept until the deque is destroyed.
+template <typename T>
+class WorkStealingDeque {
+ public:
+  explicit WorkStealingDeque(int log_capacity = 8)
+    : top_(0), bottom_(0) {
+    Array* array = new Array(static_cast<Atomic64>(1) << log_capacity);
+    arrays_.push_back(array);
+    Release_Store(&array_, reinterpret_cast<AtomicWord>(array));
+  }
+
+  ~WorkStealingDeque() {
+    for (size_t i = 0; i < arrays_.size(); ++i)
+      delete arrays_[i];
+  }
+
+  // Owner only.
+  void Push(T* item) {
+    Atomic64 bottom = NoBarrier_Load(&bottom_);
+    Atomic64 top = Acquire_Load(&top_);
+    Array* array = current_array();
+    if (bottom - top > array->capacity - 1)
+      array = Grow(array, top, bottom);
+    array->Put(bottom, item);
+    Release_Store(&bottom_, bottom + 1);
+  }
+
+  // Owner only. Returns nullptr when the deque is empty.
+  T* Pop() {
+    Atomic64 bottom = NoBarrier_Load(&bottom_) - 1;
+    Array* array = current_array();
+    NoBarrier_Store(&bottom_, bottom);
+    MemoryBarrier();
+    Atomic64 top = NoBarrier_Load(&top_);
+    if (top > bottom) {
+      NoBarrier_Store(&bottom_, bottom + 1);
+      return nullptr;
+    }
+    T* item = array->Get(bottom);
+    if (top == bottom) {
+      // The last item: race the thieves for it.
+      MemoryBarrier();
+      if (NoBarrier_CompareAndSwap(&top_, top, top + 1) != top)
+        item = nullptr;
+      MemoryBarrier();
+      NoBarrier_Store(&bottom_, bottom + 1);
+    }
+    return item;
+  }
+
+  // Any thread. Returns nullptr when the deque is empty or another thread
+  // won the race for the top item.
+  T* Steal() {
+    Atomic64 top = Acquire_Load(&top_);
+    MemoryBarrier();
+    Atomic64 bottom = Acquire_Load(&bottom_);
+    if (top >= bottom)
+      return nullptr;
+    Array* array = current_array();
+    T* item = array->Get(top);
+    MemoryBarrier();
+    if (NoBarrier_CompareAndSwap(&top_, top, top + 1) != top)
+      return nullptr;
+    MemoryBarrier();
+    return item;
+  }
+
+  // A snapshot, only exact while no other thread touches the deque.
+  bool IsEmpty() const {
+    return Acquire_Load(&bottom_) <= Acquire_Load(&top_);
+  }
+
+ private:
+  struct Array {
+    explicit Array(Atomic64 capacity)
+      : capacity(capacity), mask(capacity - 1),
+        slots(new AtomicWord[capacity]) {}
+    ~Array() { delete[] slots; }
+
+    T* Get(Atomic64 index) const {
+      return reinterpret_cast<T*>(NoBarrier_Load(&slots[index & mask]));
+    }
+    void Put(Atomic64 index, T* item) {
+      NoBarrier_Store(&slots[index & mask], reinterpret_cast<AtomicWord>(item));
+    }
+
+    const Atomic64 capacity;
+    const Atomic64 mask;
+    AtomicWord* slots;
+  };
+
+  Array* current_array() const {
+    return reinterpret_cast<Array*>(Acquire_Load(&array_));
+  }
+
+  Array* Grow(Array* old_array, Atomic64 top, Atomic64 bottom) {
+    Array* array = new Array(old_array->capacity * 2);
+    for (Atomic64 i = top; i < bottom; ++i)
+      array->Put(i, old_array->Get(i));
+    arrays_.push_back(array);
+    Release_Store(&array_, reinterpret_cast<AtomicWord>(array));
+    return array;
+  }
+
+  volatile Atomic64 top_;
+  volatile Atomic64 bottom_;
+  volatile AtomicWord array_;
+  std::vector<Array*> arrays_;  // Owner only.
+
+  DISALLOW_COPY_AND_ASSIGN(WorkStealingDeque);
+};
+
+} // namespace mrpc
+#endif // MRPC_BASE_WORK_STEALING_DEQUE_H_
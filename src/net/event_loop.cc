@@ -0,0 +1,268 @@
+#include "net/event_loop.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace mrpc {
+
+namespace {
+
+const int kInitialEventCount = 64;
+
+} // namespace
+
+EventLoop::EventLoop()
+  : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+    wakeup_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+    thread_id_(0),
+    quit_(false),
+    events_(kInitialEventCount),
+    next_timer_id_(0) {
+  PCHECK(epoll_fd_ >= 0) << "epoll_create1";
+  PCHECK(wakeup_fd_ >= 0) << "eventfd";
+  // Level-triggered, so that a wakeup is never lost between the read that
+  // clears it and the next epoll_wait().
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.ptr = nullptr;
+  PCHECK(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &event) == 0);
+}
+
+EventLoop::~EventLoop() {
+  for (std::map<int, FdWatch*>::iterator it = watches_.begin();
+       it != watches_.end(); ++it) {
+    delete it->second;
+  }
+  for (size_t i = 0; i < removed_watches_.size(); ++i)
+    delete removed_watches_[i];
+  close(wakeup_fd_);
+  close(epoll_fd_);
+}
+
+bool EventLoop::RunsTasksOnCurrentThread() const {
+  return static_cast<Thread::ThreadId>(Acquire_Load(&thread_id_)) ==
+         Thread::CurrentId();
+}
+
+void EventLoop::Run() {
+  Release_Store(&thread_id_, static_cast<AtomicWord>(Thread::CurrentId()));
+  quit_ = false;
+  while (!quit_) {
+    RunPendingTasks();
+    if (quit_)
+      break;
+    RunDueTimers();
+    if (quit_)
+      break;
+
+    int count = epoll_wait(epoll_fd_, &events_[0],
+                           static_cast<int>(events_.size()), ComputeTimeout());
+    if (count < 0) {
+      DCHECK_EQ(EINTR, errno);
+      continue;
+    }
+    for (int i = 0; i < count; ++i)
+      DispatchEvent(events_[i]);
+    for (size_t i = 0; i < removed_watches_.size(); ++i)
+      delete removed_watches_[i];
+    removed_watches_.clear();
+    // A full batch suggests more descriptors are ready than we can take.
+    if (count == static_cast<int>(events_.size()))
+      events_.resize(events_.size() * 2);
+  }
+  Release_Store(&thread_id_, 0);
+}
+
+void EventLoop::Quit() {
+  PostTask([this]() { quit_ = true; });
+}
+
+bool EventLoop::WatchFileDescriptor(int fd, int mode, Watcher* watcher) {
+  DCHECK(Acquire_Load(&thread_id_) == 0 || RunsTasksOnCurrentThread());
+  DCHECK(watcher);
+  DCHECK(mode & WATCH_READ_WRITE);
+  if (watches_.count(fd))
+    return false;
+
+  FdWatch* watch = new FdWatch;
+  watch->fd = fd;
+  watch->mode = mode;
+  watch->watcher = watcher;
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLET;
+  if (mode & WATCH_READ)
+    event.events |= EPOLLIN | EPOLLRDHUP;
+  if (mode & WATCH_WRITE)
+    event.events |= EPOLLOUT;
+  event.data.ptr = watch;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+    PLOG(ERROR) << "epoll_ctl(EPOLL_CTL_ADD) failed for fd " << fd;
+    delete watch;
+    return false;
+  }
+  watches_[fd] = watch;
+  return true;
+}
+
+bool EventLoop::StopWatchingFileDescriptor(int fd) {
+  DCHECK(Acquire_Load(&thread_id_) == 0 || RunsTasksOnCurrentThread());
+  std::map<int, FdWatch*>::iterator it = watches_.find(fd);
+  if (it == watches_.end())
+    return false;
+  FdWatch* watch = it->second;
+  watches_.erase(it);
+  // Clearing the watcher makes any event still queued in this batch a no-op.
+  watch->watcher = nullptr;
+  removed_watches_.push_back(watch);
+  return epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr) == 0;
+}
+
+void EventLoop::PostTask(const Closure& task) {
+  bool was_empty;
+  {
+    LockGuard<Mutex> lock_guard(&task_mutex_);
+    was_empty = pending_tasks_.empty();
+    pending_tasks_.push_back(task);
+  }
+  // The loop drains the whole queue at once, so only the post that makes it
+  // non-empty needs to wake the loop. The loop thread itself looks at the
+  // queue before it sleeps.
+  if (was_empty && !RunsTasksOnCurrentThread())
+    Wakeup();
+}
+
+EventLoop::TimerId EventLoop::PostDelayedTask(const Closure& task,
+                                              TimeDelta delay) {
+  return PostTaskAt(task, TimeTicks::Now() + delay);
+}
+
+EventLoop::TimerId EventLoop::PostTaskAt(const Closure& task,
+                                         TimeTicks run_time) {
+  Timer timer;
+  timer.run_time = run_time;
+  timer.id = Barrier_AtomicIncrement(&next_timer_id_, 1);
+  timer.task = task;
+  if (RunsTasksOnCurrentThread())
+    AddTimer(timer);
+  else
+    PostTask([this, timer]() { AddTimer(timer); });
+  return timer.id;
+}
+
+void EventLoop::CancelTimer(TimerId id) {
+  if (RunsTasksOnCurrentThread())
+    RemoveTimer(id);
+  else
+    PostTask([this, id]() { RemoveTimer(id); });
+}
+
+void EventLoop::AddTimer(const Timer& timer) {
+  live_timers_.insert(timer.id);
+  timers_.push(timer);
+}
+
+void EventLoop::RemoveTimer(TimerId id) {
+  // The heap entry is dropped lazily when it reaches the top.
+  live_timers_.erase(id);
+}
+
+void EventLoop::RunPendingTasks() {
+  std::vector<Closure> tasks;
+  {
+    LockGuard<Mutex> lock_guard(&task_mutex_);
+    tasks.swap(pending_tasks_);
+  }
+  for (size_t i = 0; i < tasks.size(); ++i)
+    tasks[i]();
+}
+
+void EventLoop::RunDueTimers() {
+  if (timers_.empty())
+    return;
+  TimeTicks now = TimeTicks::Now();
+  while (!timers_.empty() && !quit_) {
+    const Timer& top = timers_.top();
+    if (!live_timers_.count(top.id)) {
+      timers_.pop();
+      continue;
+    }
+    if (top.run_time > now)
+      break;
+    Closure task = top.task;
+    live_timers_.erase(top.id);
+    timers_.pop();
+    task();
+  }
+}
+
+int EventLoop::ComputeTimeout() {
+  {
+    LockGuard<Mutex> lock_guard(&task_mutex_);
+    if (!pending_tasks_.empty())
+      return 0;
+  }
+  while (!timers_.empty() && !live_timers_.count(timers_.top().id))
+    timers_.pop();
+  if (timers_.empty())
+    return -1;
+  // Round up so that the timer is due when epoll_wait() returns.
+  int64_t delay = (timers_.top().run_time - TimeTicks::Now()).InMicroseconds();
+  if (delay <= 0)
+    return 0;
+  int64_t timeout = (delay + Time::kMicrosecondsPerMillisecond - 1) /
+                    Time::kMicrosecondsPerMillisecond;
+  return timeout > INT32_MAX ? INT32_MAX : static_cast<int>(timeout);
+}
+
+void EventLoop::DispatchEvent(const struct epoll_event& event) {
+  if (!event.data.ptr) {
+    uint64_t value;
+    ssize_t result = read(wakeup_fd_, &value, sizeof(value));
+    DCHECK(result == sizeof(value) || errno == EAGAIN);
+    return;
+  }
+
+  FdWatch* watch = static_cast<FdWatch*>(event.data.ptr);
+  const uint32_t kReadEvents = EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP;
+  const uint32_t kWriteEvents = EPOLLOUT | EPOLLERR | EPOLLHUP;
+  if ((watch->mode & WATCH_READ) && (event.events & kReadEvents) &&
+      watch->watcher) {
+    watch->watcher->OnFileCanReadWithoutBlocking(watch->fd);
+  }
+  // The read callback may have stopped the watch.
+  if ((watch->mode & WATCH_WRITE) && (event.events & kWriteEvents) &&
+      watch->watcher) {
+    watch->watcher->OnFileCanWriteWithoutBlocking(watch->fd);
+  }
+}
+
+void EventLoop::Wakeup() {
+  uint64_t value = 1;
+  ssize_t result = write(wakeup_fd_, &value, sizeof(value));
+  // EAGAIN means the counter is saturated, which still wakes the loop.
+  DCHECK(result == sizeof(value) || errno == EAGAIN);
+}
+
+EventLoopThread::EventLoopThread(const Options& options)
+  : Thread(options) {
+}
+
+EventLoopThread::~EventLoopThread() {
+}
+
+void EventLoopThread::Stop() {
+  loop_.Quit();
+  Join();
+}
+
+void EventLoopThread::Run() {
+  loop_.Run();
+}
+
+} // namespace mrpc
@@ -0,0 +1,147 @@
+#ifndef MRPC_NET_EVENT_LOOP_H_
+#define MRPC_NET_EVENT_LOOP_H_
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#include <map>
+#include <queue>
+#include <set>
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/closure.h"
+#include "base/macros.h"
+#include "base/mutex.h"
+#include "base/thread.h"
+#include "base/time.h"
+
+namespace mrpc {
+
+// An edge-triggered epoll loop: the core of the non-blocking transport. It
+// dispatches file descriptor readiness to Watchers, runs timers ordered by
+// TimeTicks, and runs tasks posted from any thread, which wake it up through
+// an eventfd.
+//
+// Everything except PostTask(), PostDelayedTask(), CancelTimer() and Quit()
+// must be called on the thread running the loop, or before Run().
+class EventLoop {
+ public:
+  enum Mode {
+    WATCH_READ = 1 << 0,
+    WATCH_WRITE = 1 << 1,
+    WATCH_READ_WRITE = WATCH_READ | WATCH_WRITE,
+  };
+
+  // Notifications are edge-triggered: each arrives once per readiness change,
+  // so a watcher must read or write until EAGAIN before it is told again.
+  // Errors and hang-ups are reported as readability, so that the next read
+  // reports them.
+  class Watcher {
+   public:
+    virtual void OnFileCanReadWithoutBlocking(int fd) = 0;
+    virtual void OnFileCanWriteWithoutBlocking(int fd) = 0;
+
+   protected:
+    virtual ~Watcher() {}
+  };
+
+  typedef int64_t TimerId;
+
+  EventLoop();
+  ~EventLoop();
+
+  // Runs until Quit() is called.
+  void Run();
+  void Quit();
+
+  bool RunsTasksOnCurrentThread() const;
+
+  // Starts reporting readiness of |fd| to |watcher|. |fd| must be
+  // non-blocking and not watched already.
+  bool WatchFileDescriptor(int fd, int mode, Watcher* watcher);
+  // Safe to call from within a Watcher callback, for any descriptor.
+  bool StopWatchingFileDescriptor(int fd);
+
+  // Runs |task| on the loop thread. Tasks run in the order they are posted.
+  void PostTask(const Closure& task);
+
+  // Runs |task| on the loop thread once |delay| has passed, or at
+  // |run_time|. The returned id can be passed to CancelTimer().
+  TimerId PostDelayedTask(const Closure& task, TimeDelta delay);
+  TimerId PostTaskAt(const Closure& task, TimeTicks run_time);
+  void CancelTimer(TimerId id);
+
+ private:
+  struct FdWatch {
+    int fd;
+    int mode;
+    Watcher* watcher;
+  };
+
+  struct Timer {
+    TimeTicks run_time;
+    TimerId id;
+    Closure task;
+
+    // Orders the priority queue so that the earliest timer is on top.
+    bool operator<(const Timer& other) const {
+      if (run_time != other.run_time)
+        return run_time > other.run_time;
+      return id > other.id;
+    }
+  };
+
+  void RunPendingTasks();
+  void RunDueTimers();
+  void AddTimer(const Timer& timer);
+  void RemoveTimer(TimerId id);
+  // Milliseconds epoll_wait() may sleep: 0 when tasks are waiting, -1 when
+  // there is nothing to wake up for.
+  int ComputeTimeout();
+  void DispatchEvent(const struct epoll_event& event);
+  void Wakeup();
+
+  int epoll_fd_;
+  int wakeup_fd_;
+  volatile AtomicWord thread_id_;
+  bool quit_;
+
+  std::map<int, FdWatch*> watches_;
+  // Watches removed while a batch of events is dispatched. They are deleted
+  // once the batch is done, since later events may still point at them.
+  std::vector<FdWatch*> removed_watches_;
+  std::vector<struct epoll_event> events_;
+
+  std::priority_queue<Timer> timers_;
+  // Ids of timers that are scheduled and not cancelled.
+  std::set<TimerId> live_timers_;
+  volatile AtomicWord next_timer_id_;
+
+  Mutex task_mutex_;
+  std::vector<Closure> pending_tasks_;  // Protected by |task_mutex_|.
+
+  DISALLOW_COPY_AND_ASSIGN(EventLoop);
+};
+
+// A Thread that runs an EventLoop until Stop().
+class EventLoopThread : public Thread {
+ public:
+  explicit EventLoopThread(const Options& options);
+  virtual ~EventLoopThread();
+
+  EventLoop* loop() { return &loop_; }
+
+  // Quits the loop and joins the thread.
+  void Stop();
+
+  virtual void Run() override;
+
+ private:
+  EventLoop loop_;
+
+  DISALLOW_COPY_AND_ASSIGN(EventLoopThread);
+};
+
+} // namespace mrpc
+#endif // MRPC_NET_EVENT_LOOP_H_
@@ -0,0 +1,149 @@
+#include "net/event_loop.h"
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+using namespace mrpc;
+
+namespace {
+
+class ReadCollector : public EventLoop::Watcher {
+ public:
+  explicit ReadCollector(EventLoop* loop) : loop_(loop) {}
+
+  void OnFileCanReadWithoutBlocking(int fd) override {
+    char buffer[64];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+      data_.append(buffer, n);
+    loop_->StopWatchingFileDescriptor(fd);
+    loop_->Quit();
+  }
+  void OnFileCanWriteWithoutBlocking(int /* fd */) override {}
+
+  const std::string& data() const { return data_; }
+
+ private:
+  EventLoop* loop_;
+  std::string data_;
+};
+
+class WriteCounter : public EventLoop::Watcher {
+ public:
+  explicit WriteCounter(EventLoop* loop) : loop_(loop), writable_(0) {}
+
+  void OnFileCanReadWithoutBlocking(int /* fd */) override {}
+  void OnFileCanWriteWithoutBlocking(int fd) override {
+    ++writable_;
+    loop_->StopWatchingFileDescriptor(fd);
+    loop_->Quit();
+  }
+
+  int writable() const { return writable_; }
+
+ private:
+  EventLoop* loop_;
+  int writable_;
+};
+
+} // namespace
+
+TEST(EventLoopTest, RunsPostedTasksInOrder) {
+  EventLoop loop;
+  std::vector<int> order;
+  loop.PostTask([&order]() { order.push_back(1); });
+  loop.PostTask([&order, &loop]() {
+    order.push_back(2);
+    loop.PostTask([&order]() { order.push_back(3); });
+    loop.Quit();
+  });
+  loop.Run();
+  ASSERT_EQ(3u, order.size());
+  EXPECT_EQ(1, order[0]);
+  EXPECT_EQ(2, order[1]);
+  EXPECT_EQ(3, order[2]);
+}
+
+TEST(EventLoopTest, TimersRunInDeadlineOrder) {
+  EventLoop loop;
+  std::vector<int> order;
+  TimeTicks start = TimeTicks::Now();
+  loop.PostDelayedTask([&order, &loop]() {
+    order.push_back(30);
+    loop.Quit();
+  }, TimeDelta::FromMilliseconds(30));
+  loop.PostDelayedTask([&order]() { order.push_back(10); },
+                       TimeDelta::FromMilliseconds(10));
+  EventLoop::TimerId cancelled = loop.PostDelayedTask(
+      [&order]() { order.push_back(20); }, TimeDelta::FromMilliseconds(20));
+  loop.CancelTimer(cancelled);
+  loop.Run();
+  EXPECT_GE((TimeTicks::Now() - start).InMilliseconds(), 30);
+  ASSERT_EQ(2u, order.size());
+  EXPECT_EQ(10, order[0]);
+  EXPECT_EQ(30, order[1]);
+}
+
+TEST(EventLoopTest, DispatchesReadReadiness) {
+  EventLoop loop;
+  int fds[2];
+  ASSERT_EQ(0, pipe2(fds, O_NONBLOCK));
+  ReadCollector collector(&loop);
+  ASSERT_TRUE(loop.WatchFileDescriptor(fds[0], EventLoop::WATCH_READ,
+                                       &collector));
+  EXPECT_FALSE(loop.WatchFileDescriptor(fds[0], EventLoop::WATCH_READ,
+                                        &collector));
+  loop.PostDelayedTask([&fds]() {
+    ASSERT_EQ(5, write(fds[1], "hello", 5));
+  }, TimeDelta::FromMilliseconds(5));
+  loop.Run();
+  EXPECT_EQ("hello", collector.data());
+  EXPECT_FALSE(loop.StopWatchingFileDescriptor(fds[0]));
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST(EventLoopTest, DispatchesWriteReadiness) {
+  EventLoop loop;
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+  WriteCounter counter(&loop);
+  ASSERT_TRUE(loop.WatchFileDescriptor(fds[0], EventLoop::WATCH_WRITE,
+                                       &counter));
+  loop.Run();
+  EXPECT_EQ(1, counter.writable());
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST(EventLoopTest, AcceptsTasksFromOtherThreads) {
+  EventLoopThread thread(Thread::Options("event_loop"));
+  thread.Start();
+
+  Mutex mutex;
+  int count = 0;
+  Semaphore done(0);
+  const int kTasks = 1000;
+  for (int i = 0; i < kTasks; ++i) {
+    thread.loop()->PostTask([&]() {
+      EXPECT_TRUE(thread.loop()->RunsTasksOnCurrentThread());
+      LockGuard<Mutex> lock_guard(&mutex);
+      if (++count == kTasks)
+        done.Signal();
+    });
+  }
+  done.Wait();
+  EXPECT_FALSE(thread.loop()->RunsTasksOnCurrentThread());
+
+  Semaphore fired(0);
+  thread.loop()->PostDelayedTask([&fired]() { fired.Signal(); },
+                                 TimeDelta::FromMilliseconds(5));
+  fired.Wait();
+  thread.Stop();
+  EXPECT_EQ(kTasks, count);
+}
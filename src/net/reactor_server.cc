@@ -0,0 +1,166 @@
+#include "net/reactor_server.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+
+namespace mrpc {
+
+namespace {
+
+const int kListenBacklog = 1024;
+
+// The CPUs this process is allowed to run on, in increasing order.
+std::vector<int> AllowedCpus() {
+  std::vector<int> cpus;
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &cpu_set))
+        cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+} // namespace
+
+// A loop thread and the listening socket it accepts on.
+class ReactorServer::Listener : public EventLoop::Watcher {
+ public:
+  Listener(int fd, const Thread::Options& options, Delegate* delegate)
+    : fd(fd), thread(new EventLoopThread(options)), delegate_(delegate) {}
+
+  ~Listener() {
+    delete thread;
+    if (fd >= 0)
+      close(fd);
+  }
+
+  virtual void OnFileCanReadWithoutBlocking(int listen_fd) override {
+    // Edge-triggered: drain the whole backlog.
+    for (;;) {
+      int conn = accept4(listen_fd, nullptr, nullptr,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (conn >= 0) {
+        delegate_->OnConnection(thread->loop(), conn);
+        continue;
+      }
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        PLOG(ERROR) << "accept4 failed on fd " << listen_fd;
+      return;
+    }
+  }
+
+  virtual void OnFileCanWriteWithoutBlocking(int /* listen_fd */) override {}
+
+  int fd;
+  EventLoopThread* thread;
+
+ private:
+  Delegate* delegate_;
+
+  DISALLOW_COPY_AND_ASSIGN(Listener);
+};
+
+ReactorServer::ReactorServer(const Options& options, Delegate* delegate)
+  : options_(options),
+    delegate_(delegate),
+    port_(options.port()),
+    running_(false) {
+  DCHECK(delegate_);
+}
+
+ReactorServer::~ReactorServer() {
+  Stop();
+}
+
+int ReactorServer::CreateListenSocket() {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    PLOG(ERROR) << "socket failed";
+    return -1;
+  }
+  int on = 1;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port_);
+  addr.sin_addr.s_addr = htonl(options_.loopback_only() ? INADDR_LOOPBACK
+                                                        : INADDR_ANY);
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+      setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0 ||
+      bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      listen(fd, kListenBacklog) != 0) {
+    PLOG(ERROR) << "Failed to listen on port " << port_;
+    close(fd);
+    return -1;
+  }
+  if (port_ == 0) {
+    // The first socket picks the port, the rest share it.
+    socklen_t len = sizeof(addr);
+    getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &len);
+    port_ = ntohs(addr.sin_port);
+  }
+  return fd;
+}
+
+bool ReactorServer::Start() {
+  DCHECK(loops_.empty());
+  std::vector<int> cpus = AllowedCpus();
+  int num_loops = options_.num_loops();
+  if (num_loops <= 0)
+    num_loops = cpus.empty() ? 1 : static_cast<int>(cpus.size());
+
+  for (int i = 0; i < num_loops; ++i) {
+    int fd = CreateListenSocket();
+    if (fd < 0) {
+      Stop();
+      return false;
+    }
+    // Thread copies the name, truncating it to kMaxThreadNameLength.
+    std::string name = "mrpc:loop/" + std::to_string(i);
+    Thread::Options thread_options(name.c_str());
+    if (options_.pin_threads() && !cpus.empty())
+      thread_options.set_cpu(cpus[i % cpus.size()]);
+    Listener* listener = new Listener(fd, thread_options, delegate_);
+    loops_.push_back(listener);
+    // The loop is not running yet, so it can be set up from here.
+    CHECK(listener->thread->loop()->WatchFileDescriptor(
+        fd, EventLoop::WATCH_READ, listener));
+  }
+  for (size_t i = 0; i < loops_.size(); ++i)
+    loops_[i]->thread->Start();
+  running_ = true;
+  return true;
+}
+
+EventLoop* ReactorServer::loop(int index) {
+  return loops_[index]->thread->loop();
+}
+
+void ReactorServer::Stop() {
+  if (running_) {
+    for (size_t i = 0; i < loops_.size(); ++i) {
+      EventLoop* loop = loops_[i]->thread->loop();
+      int fd = loops_[i]->fd;
+      loop->PostTask([loop, fd]() { loop->StopWatchingFileDescriptor(fd); });
+      loops_[i]->thread->Stop();
+    }
+    running_ = false;
+  }
+  for (size_t i = 0; i < loops_.size(); ++i)
+    delete loops_[i];
+  loops_.clear();
+}
+
+} // namespace mrpc
@@ -0,0 +1,85 @@
+#ifndef MRPC_NET_REACTOR_SERVER_H_
+#define MRPC_NET_REACTOR_SERVER_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "base/macros.h"
+#include "net/event_loop.h"
+
+namespace mrpc {
+
+// A TCP server with one EventLoopThread per core. Each loop owns its own
+// SO_REUSEPORT listening socket bound to the same port, so the kernel
+// spreads incoming connections across loops and accept() never contends on
+// a single socket. Every accepted connection then stays on the loop that
+// accepted it.
+class ReactorServer {
+ public:
+  class Delegate {
+   public:
+    // Called on |loop|'s thread with a non-blocking connected socket. The
+    // delegate owns |fd| from then on.
+    virtual void OnConnection(EventLoop* loop, int fd) = 0;
+
+   protected:
+    virtual ~Delegate() {}
+  };
+
+  class Options {
+   public:
+    Options() : port_(0), loopback_only_(true), num_loops_(0),
+                pin_threads_(true) {}
+
+    // 0 lets the kernel choose; port() reports the choice after Start().
+    uint16_t port() const { return port_; }
+    void set_port(uint16_t port) { port_ = port; }
+    // Binds to 127.0.0.1 when true, and to INADDR_ANY otherwise.
+    bool loopback_only() const { return loopback_only_; }
+    void set_loopback_only(bool loopback_only) {
+      loopback_only_ = loopback_only;
+    }
+    // 0 starts one loop per CPU this process may run on.
+    int num_loops() const { return num_loops_; }
+    void set_num_loops(int num_loops) { num_loops_ = num_loops; }
+    // Pins loop i to the i-th CPU this process may run on.
+    bool pin_threads() const { return pin_threads_; }
+    void set_pin_threads(bool pin_threads) { pin_threads_ = pin_threads; }
+
+   private:
+    uint16_t port_;
+    bool loopback_only_;
+    int num_loops_;
+    bool pin_threads_;
+  };
+
+  ReactorServer(const Options& options, Delegate* delegate);
+  ~ReactorServer();
+
+  // Binds every listening socket and starts the loops. Returns false, with
+  // nothing left running, if any socket cannot be set up.
+  bool Start();
+  // Closes the listening sockets and joins the loops.
+  void Stop();
+
+  uint16_t port() const { return port_; }
+  int num_loops() const { return static_cast<int>(loops_.size()); }
+  EventLoop* loop(int index);
+
+ private:
+  class Listener;
+
+  int CreateListenSocket();
+
+  Options options_;
+  Delegate* delegate_;
+  uint16_t port_;
+  bool running_;
+  std::vector<Listener*> loops_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReactorServer);
+};
+
+} // namespace mrpc
+#endif // MRPC_NET_REACTOR_SERVER_H_
@@ -0,0 +1,126 @@
+#include "net/reactor_server.h"
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <set>
+#include <string>
+
+using namespace mrpc;
+
+namespace {
+
+class CountingDelegate : public ReactorServer::Delegate {
+ public:
+  CountingDelegate() : count_(0), accepted_(0) {}
+
+  void OnConnection(EventLoop* loop, int fd) override {
+    EXPECT_TRUE(loop->RunsTasksOnCurrentThread());
+    char name[Thread::kMaxThreadNameLength];
+    prctl(PR_GET_NAME, reinterpret_cast<unsigned long>(name), 0, 0, 0);
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    close(fd);
+
+    LockGuard<Mutex> lock_guard(&mutex_);
+    thread_names_.insert(name);
+    EXPECT_EQ(1, CPU_COUNT(&cpu_set));
+    ++count_;
+    accepted_.Signal();
+  }
+
+  void WaitForConnections(int n) {
+    for (int i = 0; i < n; ++i)
+      accepted_.Wait();
+  }
+
+  std::set<std::string> thread_names() {
+    LockGuard<Mutex> lock_guard(&mutex_);
+    return thread_names_;
+  }
+
+ private:
+  Mutex mutex_;
+  std::set<std::string> thread_names_;
+  int count_;
+  Semaphore accepted_;
+};
+
+int Connect(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  EXPECT_EQ(0, connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                       sizeof(addr)));
+  return fd;
+}
+
+} // namespace
+
+TEST(ReactorServerTest, AcceptsOnEveryLoop) {
+  CountingDelegate delegate;
+  ReactorServer::Options options;
+  options.set_num_loops(4);
+  ReactorServer server(options, &delegate);
+  ASSERT_TRUE(server.Start());
+  EXPECT_EQ(4, server.num_loops());
+  ASSERT_NE(0, server.port());
+
+  const int kConnections = 64;
+  for (int i = 0; i < kConnections; ++i)
+    close(Connect(server.port()));
+  delegate.WaitForConnections(kConnections);
+  server.Stop();
+
+  std::set<std::string> names = delegate.thread_names();
+  EXPECT_FALSE(names.empty());
+  for (std::set<std::string>::iterator it = names.begin(); it != names.end();
+       ++it) {
+    EXPECT_EQ(0u, it->find("mrpc:loop/"));
+  }
+}
+
+TEST(ReactorServerTest, DefaultsToOneLoopPerCpu) {
+  CountingDelegate delegate;
+  ReactorServer server(ReactorServer::Options(), &delegate);
+  ASSERT_TRUE(server.Start());
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  ASSERT_EQ(0, sched_getaffinity(0, sizeof(cpu_set), &cpu_set));
+  EXPECT_EQ(CPU_COUNT(&cpu_set), server.num_loops());
+  close(Connect(server.port()));
+  delegate.WaitForConnections(1);
+}
+
+TEST(ReactorServerTest, FailsWhenPortIsTaken) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(0, bind(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                    sizeof(addr)));
+  ASSERT_EQ(0, listen(fd, 1));
+  socklen_t len = sizeof(addr);
+  getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &len);
+
+  CountingDelegate delegate;
+  ReactorServer::Options options;
+  options.set_port(ntohs(addr.sin_port));
+  options.set_num_loops(2);
+  ReactorServer server(options, &delegate);
+  EXPECT_FALSE(server.Start());
+  EXPECT_EQ(0, server.num_loops());
+  close(fd);
+}